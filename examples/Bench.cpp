@@ -0,0 +1,180 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+#include "../src/Corpus.h"
+#include "../src/Similarity.h"
+#include "../src/Thumbhash.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// every operator new in the process goes through here, so each benchmark can report allocs/op;
+// lodepng allocates with malloc, so the PNG benchmarks only count the C++ side
+static atomic<size_t> allocations(0);
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, memory_order_relaxed);
+    void* block = malloc(size ? size : 1);
+    if (!block) throw bad_alloc();
+    return block;
+}
+
+void operator delete(void* block) noexcept {
+    free(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    free(block);
+}
+
+// keeps the optimizer from dropping a result the benchmark never otherwise reads
+static volatile size_t sink;
+
+class Benchmark {
+    public:
+        string name_;
+        size_t bytes_; /* the bytes one operation processes, for MB/s */
+        size_t max_allocations_; /* the most operator new calls one operation may make */
+        function<void()> run_;
+
+        Benchmark(string const & name, size_t bytes, size_t max_allocations, function<void()> run) {
+            name_               = name;
+            bytes_              = bytes;
+            max_allocations_    = max_allocations;
+            run_                = run;
+        }
+};
+
+// runs a benchmark once after a warm-up and checks its allocations against the budget
+static bool CheckAllocations(Benchmark const & benchmark) {
+    benchmark.run_();
+    size_t allocations_before = allocations.load();
+    benchmark.run_();
+    size_t allocated = allocations.load() - allocations_before;
+    bool passed = allocated <= benchmark.max_allocations_;
+    printf("%-32s %4s %6zu allocations, budget %zu\n", benchmark.name_.c_str(), passed ? "ok" : "FAIL",
+            allocated, benchmark.max_allocations_);
+    return passed;
+}
+
+// runs a benchmark in growing batches until one lasts min_seconds, then reports that batch
+static void Report(Benchmark const & benchmark, double min_seconds) {
+    benchmark.run_(); // warm up caches and function-local statics
+    size_t iterations = 1;
+    while (true) {
+        size_t allocations_before = allocations.load();
+        steady_clock::time_point start = steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+            benchmark.run_();
+        double seconds = duration<double>(steady_clock::now() - start).count();
+        size_t allocated = allocations.load() - allocations_before;
+        if (seconds >= min_seconds || iterations >= ((size_t) 1 << 30)) {
+            double ns = seconds * 1e9 / iterations;
+            printf("%-32s %12zu %14.1f %10.1f %12.2f\n", benchmark.name_.c_str(), iterations, ns,
+                    benchmark.bytes_ / ns * 1e3, (double) allocated / iterations);
+            return;
+        }
+        // aim past the target from the rate so far, like Google Benchmark does
+        double scale = seconds > 0 ? 1.4 * min_seconds / seconds : 10.0;
+        iterations = (size_t) (iterations * min(10.0, max(2.0, scale)));
+    }
+}
+
+int main(int argc, char** argv) {
+    bool check_allocations = argc > 1 && string(argv[1]) == "--check-allocs";
+    int first = check_allocations ? 2 : 1;
+    string filter = argc > first ? argv[first] : "";
+    double min_seconds = argc > first + 1 ? atof(argv[first + 1]) : 0.5;
+
+    // photo-like content for opaque images and sprites for alpha, the same on every run
+    CorpusGenerator corpus(1);
+    ThumbHash th;
+    vector<Benchmark> benchmarks;
+    const unsigned int sizes[] = { 32, 64, 128, 256, 512, 1000 };
+    for (unsigned int s = 0; s < 6; s++)
+        for (int alpha = 0; alpha < 2; alpha++) {
+            unsigned int size = sizes[s];
+            shared_ptr<Image> image = make_shared<Image>(corpus.GenerateImage(
+                    alpha ? CorpusPattern::kSprite : CorpusPattern::kPhoto, size, size, 0));
+            // a fresh scratch per call: the l, p, q and a planes, the AC terms of its four Channels
+            // and the DCT's row of cosines
+            benchmarks.push_back(Benchmark("encode/" + to_string(size) + (alpha ? "/alpha" : "/opaque"),
+                    size * size * 4, alpha ? 9 : 8, [&th, image] {
+                uint8_t hash[ThumbHash::kMaxHashSize];
+                sink = th.RGBAToThumbHash(*image, hash);
+            }));
+        }
+
+    // with a reused ThumbHashScratch the planes, Channels and cosine row are allocated once
+    ThumbHashScratch scratch;
+    for (int alpha = 0; alpha < 2; alpha++) {
+        shared_ptr<Image> image = make_shared<Image>(corpus.GenerateImage(
+                alpha ? CorpusPattern::kSprite : CorpusPattern::kPhoto, 256, 256, 0));
+        benchmarks.push_back(Benchmark(string("encode/256/") + (alpha ? "alpha" : "opaque") + "/scratch",
+                256 * 256 * 4, 0, [&scratch, image] {
+            uint8_t hash[ThumbHash::kMaxHashSize];
+            sink = ThumbHash::RGBAToThumbHash(*image, hash, false, scratch);
+        }));
+    }
+
+    Image source = corpus.GenerateImage(CorpusPattern::kSprite, 256, 192, 0);
+    vector<uint8_t> hash = th.RGBAToThumbHash(source);
+    const unsigned int outputs[] = { 32, 64, 128, 256 };
+    for (unsigned int s = 0; s < 4; s++) {
+        unsigned int size = outputs[s];
+        // only the returned Image's pixels
+        benchmarks.push_back(Benchmark("decode/" + to_string(size), size * size * 4, 1, [&th, &hash, size] {
+            sink = th.ThumbHashToRGBA(hash, size, size).image_data_.size();
+        }));
+    }
+    Image decoded;
+    benchmarks.push_back(Benchmark("decode/64/into", 64 * 64 * 4, 0, [&hash, &decoded] {
+        ThumbHash::ThumbHashToRGBA(hash, 64, 64, false, decoded);
+        sink = decoded.image_data_.size();
+    }));
+    benchmarks.push_back(Benchmark("average", hash.size(), 0, [&th, &hash] {
+        sink = th.ThumbHashToAverageRGBA(hash).red_;
+    }));
+    benchmarks.push_back(Benchmark("aspect", hash.size(), 0, [&th, &hash] {
+        sink = (size_t) (1000 * th.ThumbHashToApproximateAspectRatio(hash));
+    }));
+    vector<uint8_t> other = th.RGBAToThumbHash(corpus.GenerateImage(CorpusPattern::kPhoto, 256, 192, 1));
+    benchmarks.push_back(Benchmark("distance", hash.size() + other.size(), 0, [&hash, &other] {
+        sink = (size_t) (1000 * ThumbHashDistance(hash, other));
+    }));
+
+    vector<unsigned char> png;
+    source.WriteToMemory(png);
+    benchmarks.push_back(Benchmark("png/read/256x192", png.size(), 2, [&png] {
+        Image image;
+        sink = image.ReadFromMemory(png);
+    }));
+    benchmarks.push_back(Benchmark("png/read-native/256x192", png.size(), 1, [&png] {
+        PixelImage image;
+        sink = image.ReadFromMemory(png);
+    }));
+    benchmarks.push_back(Benchmark("png/write/256x192", source.width_ * source.height_ * 4, 2, [&source] {
+        vector<unsigned char> out;
+        sink = source.WriteToMemory(out);
+    }));
+
+    // with --check-allocs, fail if any path allocates more than its budget instead of timing
+    if (check_allocations) {
+        bool passed = true;
+        for (unsigned int i = 0; i < benchmarks.size(); i++)
+            if (benchmarks[i].name_.find(filter) != string::npos)
+                passed = CheckAllocations(benchmarks[i]) && passed;
+        return passed ? 0 : 1;
+    }
+    printf("%-32s %12s %14s %10s %12s\n", "benchmark", "iterations", "ns/op", "MB/s", "allocs/op");
+    for (unsigned int i = 0; i < benchmarks.size(); i++)
+        if (benchmarks[i].name_.find(filter) != string::npos)
+            Report(benchmarks[i], min_seconds);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/stat.h>
+#include "../src/Corpus.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "usage: th-corpus <directory> [count] [seed]" << endl;
+        return 1;
+    }
+    string directory = argv[1];
+    unsigned int count = argc > 2 ? atoi(argv[2]) : 75;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1;
+    mkdir(directory.c_str(), 0755);
+
+    CorpusGenerator generator(seed);
+    ImageStatus status;
+    unsigned int written = generator.WriteCorpus(directory, count, status);
+    if (!status.Ok())
+        cerr << status.Message() << endl;
+    cout << "wrote " << written << " images to " << directory << endl;
+    return written == count ? 0 : 1;
+}
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include "../src/DedupTable.h"
+#include "../src/HashStore.h"
+#include "../src/IncrementalHasher.h"
+
+using namespace std;
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		cerr << "usage: th-index <directory> <manifest> [store]" << endl;
+		return 1;
+	}
+	string root = argv[1];
+	while (root.size() > 1 && root[root.size() - 1] == '/')
+		root.erase(root.size() - 1);
+
+	IncrementalHasher hasher;
+	FileStatus status;
+	if (!hasher.ReadManifest(argv[2], status)) {
+		cerr << status.Message() << endl;
+		return 1;
+	}
+
+	// content already in the manifest is a dedup hit wherever it shows up again
+	DedupTable dedup;
+	map<string, ManifestEntry> const & known = hasher.Entries();
+	for (map<string, ManifestEntry>::const_iterator it = known.begin(); it != known.end(); ++it)
+		if (!it->second.hash_.empty())
+			dedup.Insert(it->second.digest_, it->second.hash_);
+	hasher.UseDedupTable(&dedup);
+
+	IncrementalStats stats = hasher.Update(root);
+	for (map<string, string>::const_iterator it = stats.failures_.begin(); it != stats.failures_.end(); ++it)
+		cerr << it->first << ": " << it->second << endl;
+	if (!hasher.WriteManifest(argv[2], status)) {
+		cerr << status.Message() << endl;
+		return 1;
+	}
+	cout << "scanned " << stats.scanned_ << ", unchanged " << stats.unchanged_
+		<< ", touched " << stats.touched_ << ", rehashed " << stats.rehashed_
+		<< ", removed " << stats.removed_ << ", failed " << stats.failed_ << endl;
+	DedupStats dedup_stats = dedup.Stats();
+	cout << "dedup: " << dedup_stats.hits_ << " of " << dedup_stats.lookups_
+		<< " changed files reused an existing hash (" << 100.0 * dedup_stats.HitRate() << "%)" << endl;
+
+	// optionally publish the manifest as a memory-mappable store
+	if (argc > 3) {
+		HashStoreWriter writer;
+		map<string, ManifestEntry> const & entries = hasher.Entries();
+		for (map<string, ManifestEntry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+			if (!it->second.hash_.empty())
+				writer.Add(it->first, it->second.hash_);
+		if (!writer.WriteToFile(argv[3], status)) {
+			cerr << status.Message() << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../src/Base64.h"
+#include "../src/Thumbhash.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// opens a keep-alive connection to the server, or returns -1
+static int Connect(string const & host, int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    inet_pton(AF_INET, host.c_str(), &address.sin_addr);
+    if (connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    return fd;
+}
+
+// reads one response and returns its status code, or -1 if the connection failed
+static int ReadResponse(int fd, string& buffer) {
+    char chunk[16384];
+    size_t end;
+    while ((end = buffer.find("\r\n\r\n")) == string::npos) {
+        ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count <= 0) return -1;
+        buffer.append(chunk, count);
+    }
+    string head = buffer.substr(0, end);
+    for (unsigned int i = 0; i < head.size(); i++)
+        head[i] = tolower(head[i]);
+    size_t length_at = head.find("content-length:");
+    size_t length = length_at == string::npos ? 0 : strtoul(head.c_str() + length_at + 15, nullptr, 10);
+    while (buffer.size() < end + 4 + length) {
+        ssize_t count = read(fd, chunk, sizeof(chunk));
+        if (count <= 0) return -1;
+        buffer.append(chunk, count);
+    }
+    buffer.erase(0, end + 4 + length);
+    return atoi(head.c_str() + 9);
+}
+
+int main(int argc, char** argv) {
+    string host = argc > 1 ? argv[1] : "127.0.0.1";
+    int port = argc > 2 ? atoi(argv[2]) : 8080;
+    unsigned int connections = argc > 3 ? atoi(argv[3]) : 8;
+    double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+
+    // the request mix: every bundled image at the default size and a few explicit sizes
+    ThumbHash th;
+    vector<string> targets;
+    const char* names[] = { "bart", "flower", "shark" };
+    const char* sizes[] = { "", "?w=16&h=16", "?w=32&h=24", "?w=64&h=64" };
+    for (unsigned int i = 0; i < 3; i++) {
+        Image input;
+        if (!input.ReadFromFile(string("examples/images-original/") + names[i] + ".png"))
+            return 1;
+        vector<uint8_t> hash = th.RGBAToThumbHash(input);
+        string encoded = Base64Encode(hash);
+        for (unsigned int c = 0; c < encoded.size(); c++) // URL-safe alphabet, no padding
+            encoded[c] = encoded[c] == '+' ? '-' : encoded[c] == '/' ? '_' : encoded[c];
+        encoded.erase(encoded.find_last_not_of('=') + 1);
+        for (unsigned int s = 0; s < 4; s++)
+            targets.push_back("/thumbhash/" + encoded + ".png" + sizes[s]);
+    }
+
+    atomic<bool> failed(false);
+    vector<vector<double>> latencies(connections);
+    steady_clock::time_point start = steady_clock::now();
+    steady_clock::time_point deadline = start + duration_cast<steady_clock::duration>(duration<double>(seconds));
+    vector<thread> clients;
+    for (unsigned int c = 0; c < connections; c++) {
+        clients.push_back(thread([&, c] {
+            int fd = Connect(host, port);
+            if (fd < 0) {
+                failed = true;
+                return;
+            }
+            string buffer;
+            for (unsigned int i = c; steady_clock::now() < deadline; i++) {
+                string request = "GET " + targets[i % targets.size()] + " HTTP/1.1\r\nHost: "
+                        + host + "\r\n\r\n";
+                steady_clock::time_point sent = steady_clock::now();
+                if (write(fd, request.data(), request.size()) != (ssize_t) request.size()
+                        || ReadResponse(fd, buffer) != 200) {
+                    failed = true;
+                    break;
+                }
+                latencies[c].push_back(duration<double, micro>(steady_clock::now() - sent).count());
+            }
+            close(fd);
+        }));
+    }
+    for (unsigned int c = 0; c < clients.size(); c++)
+        clients[c].join();
+    double elapsed = duration<double>(steady_clock::now() - start).count();
+
+    vector<double> all;
+    for (unsigned int c = 0; c < connections; c++)
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+    if (failed)
+        cerr << "Some requests failed; is the server running on " << host << ":" << port << "?" << endl;
+    if (all.empty())
+        return 1;
+    sort(all.begin(), all.end());
+    cout << "requests:   " << all.size() << " over " << connections << " connections" << endl;
+    cout << "throughput: " << all.size() / elapsed << " req/s" << endl;
+    cout << "latency:    p50 " << all[all.size() / 2] << " us, p99 " << all[all.size() * 99 / 100]
+            << " us, max " << all.back() << " us" << endl;
+    return failed ? 1 : 0;
+}
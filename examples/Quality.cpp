@@ -0,0 +1,367 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../util/lodepng/Lodepng.h"
+#include "../src/Corpus.h"
+#include "../src/Thumbhash.h"
+
+using namespace std;
+using namespace std::chrono;
+
+// the longest edge placeholders are compared at, like ThumbHashToRGBA's default
+static const unsigned int kCompareEdge = 32;
+
+class Sample {
+    public:
+        string name_;
+        vector<unsigned char> png_;
+        Image image_;
+        PixelImage pixels_;
+};
+
+// hashes made by the original encoder this tree grew from, with only its uninitialized channel
+// scales zeroed as upstream does, which the reference encoder must still reproduce byte for byte:
+// the bundled photos, then generated images of every pattern
+static const char* kGoldenPhotos[][2] = {
+    { "bart", "2be9021e0af739b548b609e72989768b2588077d787f88" },
+    { "flower", "135b062e06b238493e77056799b57d7cc89893a0500719" },
+    { "shark", "5b150a1f0e4f548967a9888768a988777779682066ac9f09" }
+};
+static const unsigned int kGoldenSizes[][2] = { { 64, 48 }, { 17, 300 } };
+static const char* kGoldenGenerated[2][CorpusGenerator::kPatterns] = {
+    { "d487021d848f88888087888777778788808ff70878", "e007020d8255904d977f8a548a569a4805c912f8ab",
+      "1c270e05807788788a7778639808a7997077e2fa28", "638a812c82248f625c965438fac84570a3db35428a06835b02",
+      "22080a05807887783d576740475a69870000000000" },
+    { "df880619108f7a77877877788075075878", "20f8010100af5b75c788345bf5b2dbf35a",
+      "1e090a0102a93049755d6a89678f4fe48f", "d9b7850904258990cba647766f63f736047b7499868858",
+      "2308060100d7503aec6a87880000000000" }
+};
+
+// one way of producing and rendering a hash, measured against the reference encoder
+class Config {
+    public:
+        string name_;
+        bool linear_light_;
+        bool compared_; /* false for configurations whose hashes differ from the reference by design */
+        int tolerance_; /* the largest nibble difference from the reference that is not flagged */
+        size_t (*encode_)(ThumbHash&, Sample const &, uint8_t*);
+
+        Config(string const & name, bool linear_light, bool compared, int tolerance,
+                size_t (*encode)(ThumbHash&, Sample const &, uint8_t*)) {
+            name_           = name;
+            linear_light_   = linear_light;
+            compared_       = compared;
+            tolerance_      = tolerance;
+            encode_         = encode;
+        }
+};
+
+static size_t EncodeReference(ThumbHash& th, Sample const & sample, uint8_t* hash) {
+    return th.RGBAToThumbHash(sample.image_, hash);
+}
+
+// 16-bit sources keep precision the 8-bit reference path rounds away, so their hashes are not compared
+static bool IsWide(PixelImage const & image) {
+    return image.format_ == PixelFormat::kGrey16 || image.format_ == PixelFormat::kGreyAlpha16
+            || image.format_ == PixelFormat::kRGB16 || image.format_ == PixelFormat::kRGBA16;
+}
+
+static size_t EncodeNative(ThumbHash& th, Sample const & sample, uint8_t* hash) {
+    return th.RGBAToThumbHash(sample.pixels_, hash);
+}
+
+static size_t EncodeFixedPoint(ThumbHash& th, Sample const & sample, uint8_t* hash) {
+    return th.RGBAToThumbHashFixedPoint(sample.image_, hash);
+}
+
+static size_t EncodeLinearLight(ThumbHash& th, Sample const & sample, uint8_t* hash) {
+    return th.RGBAToThumbHash(sample.image_, hash, true);
+}
+
+// composites a pixel over white, since a placeholder is judged by how it looks on the page
+static void Composite(RGBAPixel const & pixel, float* rgb) {
+    float alpha = pixel.alpha_ / 255.0f;
+    rgb[0] = pixel.red_ * alpha + 255.0f * (1.0f - alpha);
+    rgb[1] = pixel.green_ * alpha + 255.0f * (1.0f - alpha);
+    rgb[2] = pixel.blue_ * alpha + 255.0f * (1.0f - alpha);
+}
+
+// box-filters an image down to width x height composited RGB, averaging every source pixel once
+static vector<float> Downsample(Image const & image, unsigned int width, unsigned int height) {
+    vector<float> sums(width * height * 3, 0.0f), counts(width * height, 0.0f);
+    for (unsigned int y = 0; y < image.height_; y++)
+        for (unsigned int x = 0; x < image.width_; x++) {
+            unsigned int target = x * width / image.width_ + y * height / image.height_ * width;
+            float rgb[3];
+            Composite(image.image_data_[x + y * image.width_], rgb);
+            for (int c = 0; c < 3; c++)
+                sums[target * 3 + c] += rgb[c];
+            counts[target]++;
+        }
+    for (unsigned int i = 0; i < width * height; i++)
+        for (int c = 0; c < 3; c++)
+            sums[i * 3 + c] /= max(1.0f, counts[i]);
+    return sums;
+}
+
+static vector<float> Flatten(Image const & image) {
+    vector<float> rgb(image.width_ * image.height_ * 3);
+    for (unsigned int i = 0; i < image.width_ * image.height_; i++)
+        Composite(image.image_data_[i], &rgb[i * 3]);
+    return rgb;
+}
+
+static double PSNR(vector<float> const & a, vector<float> const & b) {
+    double error = 0;
+    for (unsigned int i = 0; i < a.size(); i++)
+        error += (a[i] - b[i]) * (a[i] - b[i]);
+    error /= a.size();
+    return error > 0 ? 10.0 * log10(255.0 * 255.0 / error) : 99.0;
+}
+
+// mean SSIM of the luma over 8x8 windows at a stride of 4, shrunk to fit small images
+static double SSIM(vector<float> const & a, vector<float> const & b, unsigned int width, unsigned int height) {
+    const double c1 = (0.01 * 255) * (0.01 * 255), c2 = (0.03 * 255) * (0.03 * 255);
+    unsigned int window_x = min(8u, width), window_y = min(8u, height);
+    double total = 0;
+    int windows = 0;
+    for (unsigned int top = 0; top + window_y <= height; top += 4) {
+        for (unsigned int left = 0; left + window_x <= width; left += 4) {
+            double mean_a = 0, mean_b = 0, var_a = 0, var_b = 0, covariance = 0;
+            int n = window_x * window_y;
+            for (unsigned int y = top; y < top + window_y; y++)
+                for (unsigned int x = left; x < left + window_x; x++) {
+                    unsigned int i = (x + y * width) * 3;
+                    double la = 0.299 * a[i] + 0.587 * a[i + 1] + 0.114 * a[i + 2];
+                    double lb = 0.299 * b[i] + 0.587 * b[i + 1] + 0.114 * b[i + 2];
+                    mean_a += la;
+                    mean_b += lb;
+                    var_a += la * la;
+                    var_b += lb * lb;
+                    covariance += la * lb;
+                }
+            mean_a /= n;
+            mean_b /= n;
+            var_a = var_a / n - mean_a * mean_a;
+            var_b = var_b / n - mean_b * mean_b;
+            covariance = covariance / n - mean_a * mean_b;
+            total += (2 * mean_a * mean_b + c1) * (2 * covariance + c2)
+                    / ((mean_a * mean_a + mean_b * mean_b + c1) * (var_a + var_b + c2));
+            windows++;
+            if (left + window_x == width) break;
+        }
+        if (top + window_y == height) break;
+    }
+    return windows > 0 ? total / windows : 1.0;
+}
+
+// marks the 4-bit fields of a hash that cannot change the decoded image: the AC terms of
+// channels whose quantized scale is 0, which encoders are free to fill with anything
+static vector<bool> IgnoredNibbles(uint8_t const * hash, size_t size) {
+    vector<bool> ignored(size * 2, false);
+    ThumbHashHeader header;
+    if (!header.Parse(hash, size))
+        return ignored;
+    int counts[4] = { Channel::CountAC(header.lx_, header.ly_), Channel::CountAC(3, 3), Channel::CountAC(3, 3),
+            header.has_alpha_ ? Channel::CountAC(5, 5) : 0 };
+    float scales[4] = { header.l_scale_, header.p_scale_, header.q_scale_, header.a_scale_ };
+    size_t nibble = header.ac_start_ * 2;
+    for (int c = 0; c < 4; c++)
+        for (int i = 0; i < counts[c] && nibble < ignored.size(); i++, nibble++)
+            ignored[nibble] = scales[c] == 0;
+    return ignored;
+}
+
+// the largest difference between corresponding 4-bit fields of two hashes that can affect
+// the decoded image
+static int MaxNibbleDelta(uint8_t const * a, size_t a_size, uint8_t const * b, size_t b_size) {
+    if (a_size != b_size)
+        return 15;
+    vector<bool> a_ignored = IgnoredNibbles(a, a_size), b_ignored = IgnoredNibbles(b, b_size);
+    int delta = 0;
+    for (size_t i = 0; i < a_size * 2; i++) {
+        if (a_ignored[i] && b_ignored[i])
+            continue;
+        int shift = i % 2 == 0 ? 0 : 4;
+        delta = max(delta, abs(((a[i / 2] >> shift) & 15) - ((b[i / 2] >> shift) & 15)));
+    }
+    return delta;
+}
+
+static string Hex(vector<uint8_t> const & hash) {
+    string hex;
+    char digits[3];
+    for (unsigned int i = 0; i < hash.size(); i++) {
+        snprintf(digits, sizeof(digits), "%02x", hash[i]);
+        hex += digits;
+    }
+    return hex;
+}
+
+static bool CheckGolden(ThumbHash& th, string const & name, Image const & image, string const & golden) {
+    string hex = Hex(th.RGBAToThumbHash(image));
+    if (hex == golden)
+        return true;
+    printf("  FLAG reference: %s hashes to %s, the original encoder to %s\n", name.c_str(), hex.c_str(),
+            golden.c_str());
+    return false;
+}
+
+// checks the reference encoder against the original one, so the baseline every configuration
+// is measured against cannot drift unnoticed. Returns the number of golden hashes that differ.
+static int CheckGoldenHashes(ThumbHash& th) {
+    int checked = 0, differ = 0, missing = 0;
+    for (unsigned int i = 0; i < 3; i++) {
+        Image image;
+        ImageStatus status;
+        if (!image.ReadFromFile(string("examples/images-original/") + kGoldenPhotos[i][0] + ".png", status)) {
+            missing++;
+            continue;
+        }
+        differ += !CheckGolden(th, kGoldenPhotos[i][0], image, kGoldenPhotos[i][1]);
+        checked++;
+    }
+    CorpusGenerator generator(1);
+    for (unsigned int s = 0; s < 2; s++)
+        for (unsigned int p = 0; p < CorpusGenerator::kPatterns; p++) {
+            CorpusPattern pattern = (CorpusPattern) p;
+            Image image = generator.GenerateImage(pattern, kGoldenSizes[s][0], kGoldenSizes[s][1],
+                    p + CorpusGenerator::kPatterns * s);
+            differ += !CheckGolden(th, CorpusGenerator::PatternName(pattern) + "/" + to_string(kGoldenSizes[s][0])
+                    + "x" + to_string(kGoldenSizes[s][1]), image, kGoldenGenerated[s][p]);
+            checked++;
+        }
+    printf("golden hashes: %d of %d match the original encoder", checked - differ, checked);
+    if (missing > 0)
+        printf(", %d bundled photos not compared (run from the repository root)", missing);
+    printf("\n");
+    return differ;
+}
+
+static bool LoadDirectory(string const & directory, vector<Sample>& samples) {
+    DIR* listing = opendir(directory.c_str());
+    if (!listing) {
+        cerr << "Cannot open directory " << directory << endl;
+        return false;
+    }
+    vector<string> names;
+    while (dirent* entry = readdir(listing)) {
+        string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".png") == 0)
+            names.push_back(name);
+    }
+    closedir(listing);
+    sort(names.begin(), names.end());
+    for (unsigned int i = 0; i < names.size(); i++) {
+        Sample sample;
+        sample.name_ = names[i];
+        if (lodepng::load_file(sample.png_, directory + "/" + names[i]) == 0)
+            samples.push_back(sample);
+    }
+    return true;
+}
+
+static void GenerateSamples(unsigned int count, vector<Sample>& samples) {
+    static const unsigned int sizes[][2] = {
+        { 32, 32 }, { 100, 75 }, { 256, 256 }, { 17, 300 }, { 640, 480 }, { 1000, 1 }
+    };
+    CorpusGenerator generator(1);
+    for (unsigned int i = 0; i < count; i++) {
+        CorpusPattern pattern = (CorpusPattern) (i % CorpusGenerator::kPatterns);
+        CorpusEncoding encoding = (CorpusEncoding) (i / CorpusGenerator::kPatterns % CorpusGenerator::kEncodings);
+        unsigned int const * size = sizes[i % 6];
+        Sample sample;
+        ImageStatus status;
+        sample.name_ = CorpusGenerator::PatternName(pattern) + "/" + CorpusGenerator::EncodingName(encoding);
+        if (CorpusGenerator::EncodePNG(generator.Generate(pattern, size[0], size[1], i), size[0], size[1],
+                encoding, sample.png_, status))
+            samples.push_back(sample);
+        else
+            cerr << sample.name_ << ": " << status.Message() << endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    vector<Sample> samples;
+    if (argc > 1 && atoi(argv[1]) == 0) {
+        if (!LoadDirectory(argv[1], samples)) return 1;
+    } else {
+        GenerateSamples(argc > 1 ? atoi(argv[1]) : 150, samples);
+    }
+    vector<Sample> loaded;
+    for (unsigned int i = 0; i < samples.size(); i++)
+        if (samples[i].image_.ReadFromMemory(samples[i].png_) && samples[i].pixels_.ReadFromMemory(samples[i].png_)
+                && samples[i].image_.width_ <= 1000 && samples[i].image_.height_ <= 1000)
+            loaded.push_back(samples[i]);
+    if (loaded.empty()) {
+        cerr << "usage: th-quality [directory of PNGs | number of generated images]" << endl;
+        return 1;
+    }
+
+    vector<Config> configs;
+    configs.push_back(Config("reference", false, true, 0, EncodeReference));
+    configs.push_back(Config("native-format", false, true, 0, EncodeNative));
+    configs.push_back(Config("fixed-point", false, true, 1, EncodeFixedPoint));
+    configs.push_back(Config("linear-light", true, false, 0, EncodeLinearLight)); // a different hash by design
+
+    // the reference hashes, which every other configuration is checked against byte for byte
+    ThumbHash th;
+    int golden_differ = CheckGoldenHashes(th);
+    vector<vector<uint8_t>> reference(loaded.size());
+    for (unsigned int i = 0; i < loaded.size(); i++) {
+        uint8_t hash[ThumbHash::kMaxHashSize];
+        reference[i].assign(hash, hash + EncodeReference(th, loaded[i], hash));
+    }
+
+    printf("%u images\n", (unsigned int) loaded.size());
+    printf("%-16s %12s %10s %8s %10s %10s %13s\n", "config", "encode us", "PSNR dB", "SSIM", "differ", "max delta",
+            "not compared");
+    for (unsigned int c = 0; c < configs.size(); c++) {
+        double seconds = 0, psnr = 0, ssim = 0;
+        int differ = 0, max_delta = 0, not_compared = 0;
+        for (unsigned int i = 0; i < loaded.size(); i++) {
+            Sample const & sample = loaded[i];
+            uint8_t hash[ThumbHash::kMaxHashSize];
+            size_t size = 0;
+            double best = 1e30; // the fastest of three runs, to keep scheduling noise out
+            for (int run = 0; run < 3; run++) {
+                steady_clock::time_point start = steady_clock::now();
+                size = configs[c].encode_(th, sample, hash);
+                best = min(best, duration<double>(steady_clock::now() - start).count());
+            }
+            seconds += best;
+
+            if (configs[c].compared_ && !(configs[c].encode_ == EncodeNative && IsWide(sample.pixels_))) {
+                int delta = MaxNibbleDelta(hash, size, reference[i].data(), reference[i].size());
+                differ += delta > 0;
+                max_delta = max(max_delta, delta);
+                if (delta > configs[c].tolerance_)
+                    printf("  FLAG %s: %s differs from the reference by up to %d\n", configs[c].name_.c_str(),
+                            sample.name_.c_str(), delta);
+            } else {
+                not_compared++;
+            }
+
+            unsigned int edge = max(sample.image_.width_, sample.image_.height_);
+            unsigned int width = max(1u, (sample.image_.width_ * kCompareEdge + edge / 2) / edge);
+            unsigned int height = max(1u, (sample.image_.height_ * kCompareEdge + edge / 2) / edge);
+            Image decoded = th.ThumbHashToRGBA(vector<uint8_t>(hash, hash + size), width, height,
+                    configs[c].linear_light_);
+            vector<float> expected = Downsample(sample.image_, width, height), actual = Flatten(decoded);
+            psnr += PSNR(expected, actual);
+            ssim += SSIM(expected, actual, width, height);
+        }
+        int compared = (int) loaded.size() - not_compared;
+        printf("%-16s %12.1f %10.2f %8.4f %10s %10s %13d\n", configs[c].name_.c_str(), 1e6 * seconds / loaded.size(),
+                psnr / loaded.size(), ssim / loaded.size(), compared > 0 ? to_string(differ).c_str() : "-",
+                compared > 0 ? to_string(max_delta).c_str() : "-", not_compared);
+    }
+    return golden_differ > 0 ? 1 : 0;
+}
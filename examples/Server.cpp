@@ -0,0 +1,409 @@
+#include <arpa/inet.h>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <errno.h>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../src/Base64.h"
+#include "../src/PlaceholderCache.h"
+#include "../src/StageStats.h"
+#include "../src/Thumbhash.h"
+
+using namespace std;
+
+// largest accepted request head, and largest placeholder edge in pixels
+static const size_t kMaxRequestBytes = 8192;
+static const unsigned int kMaxSize = 256;
+
+struct Connection {
+    int fd;
+    uint64_t id;        // unique per connection, so a completion never reaches a later client on the same fd
+    string in;          // bytes read but not yet parsed
+    string out;         // response bytes not yet written
+    size_t out_offset;
+    bool busy;          // a worker owns the current request
+    bool keep_alive;
+    bool peer_closed;   // the client hung up while a worker owned its request
+};
+
+struct Job {
+    int fd;
+    uint64_t id;
+    string target;
+    bool keep_alive;
+};
+
+struct Completion {
+    int fd;
+    uint64_t id;
+    string response;
+    bool keep_alive;
+};
+
+class Server {
+    public:
+        Server(unsigned int workers, size_t cache_bytes) : cache_(cache_bytes, 16), stopping_(false), next_id_(0) {
+            for (unsigned int i = 0; i < workers; i++)
+                workers_.push_back(thread(&Server::WorkerLoop, this));
+        }
+
+        ~Server() {
+            {
+                lock_guard<mutex> guard(jobs_lock_);
+                stopping_ = true;
+            }
+            jobs_ready_.notify_all();
+            for (unsigned int i = 0; i < workers_.size(); i++)
+                workers_[i].join();
+        }
+
+        int Run(int port) {
+            int listener = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            int on = 1;
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+            sockaddr_in address;
+            memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_addr.s_addr = htonl(INADDR_ANY);
+            address.sin_port = htons(port);
+            if (bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 1024) != 0) {
+                cerr << "Cannot listen on port " << port << ": " << strerror(errno) << endl;
+                return 1;
+            }
+
+            epoll_ = epoll_create1(0);
+            wakeup_ = epoll_ < 0 ? -1 : eventfd(0, EFD_NONBLOCK);
+            if (epoll_ < 0 || wakeup_ < 0) {
+                cerr << "Cannot create the event loop: " << strerror(errno) << endl;
+                if (epoll_ >= 0) close(epoll_);
+                close(listener);
+                return 1;
+            }
+            Watch(listener, EPOLLIN);
+            Watch(wakeup_, EPOLLIN);
+            cout << "Serving /thumbhash/<base64>.png on port " << port << endl;
+
+            vector<epoll_event> events(256);
+            while (true) {
+                int ready = epoll_wait(epoll_, &events[0], events.size(), -1);
+                if (ready < 0 && errno != EINTR)
+                    break;
+                for (int i = 0; i < ready; i++) {
+                    int fd = events[i].data.fd;
+                    if (fd == listener)
+                        Accept(listener);
+                    else if (fd == wakeup_)
+                        DrainCompletions();
+                    else if (events[i].events & (EPOLLHUP | EPOLLERR))
+                        HangUp(fd);
+                    else {
+                        if (events[i].events & EPOLLIN) Read(fd);
+                        if ((events[i].events & EPOLLOUT) && connections_.count(fd)) Write(fd);
+                    }
+                }
+            }
+            return 0;
+        }
+
+    private:
+        PlaceholderCache cache_;
+        vector<thread> workers_;
+        mutex jobs_lock_;
+        condition_variable jobs_ready_;
+        deque<Job> jobs_;
+        bool stopping_;
+        mutex completions_lock_;
+        deque<Completion> completions_;
+        map<int, unique_ptr<Connection>> connections_; // only touched by the event loop
+        uint64_t next_id_; // only touched by the event loop
+        int epoll_;
+        int wakeup_;
+
+        void Watch(int fd, unsigned int events) {
+            epoll_event event;
+            event.events = events;
+            event.data.fd = fd;
+            epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event);
+        }
+
+        void Rewatch(int fd, unsigned int events) {
+            epoll_event event;
+            event.events = events;
+            event.data.fd = fd;
+            epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &event);
+        }
+
+        void Accept(int listener) {
+            while (true) {
+                int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK);
+                if (fd < 0)
+                    return;
+                int on = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                unique_ptr<Connection> connection(new Connection());
+                connection->fd = fd;
+                connection->id = next_id_++;
+                connection->out_offset = 0;
+                connection->busy = false;
+                connection->keep_alive = true;
+                connection->peer_closed = false;
+                connections_[fd] = move(connection);
+                Watch(fd, EPOLLIN);
+            }
+        }
+
+        void Close(int fd) {
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+            close(fd);
+            connections_.erase(fd);
+        }
+
+        // the client went away while a worker owns its request: stop watching the fd, but keep it
+        // open until DrainCompletions takes the completion, so accept4 cannot reuse its number
+        void Abandon(Connection& connection) {
+            connection.peer_closed = true;
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, connection.fd, nullptr);
+        }
+
+        void HangUp(int fd) {
+            map<int, unique_ptr<Connection>>::iterator found = connections_.find(fd);
+            if (found == connections_.end())
+                return;
+            if (found->second->busy)
+                Abandon(*found->second);
+            else
+                Close(fd);
+        }
+
+        void Read(int fd) {
+            map<int, unique_ptr<Connection>>::iterator found = connections_.find(fd);
+            if (found == connections_.end())
+                return;
+            Connection& connection = *found->second;
+            char buffer[4096];
+            while (true) {
+                ssize_t count = read(fd, buffer, sizeof(buffer));
+                if (count > 0) {
+                    connection.in.append(buffer, count);
+                    continue;
+                }
+                if (count == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                    if (!connection.busy)
+                        Close(fd);
+                    else
+                        Abandon(connection);
+                    return;
+                }
+                break;
+            }
+            Dispatch(connection);
+        }
+
+        // parses the next request on a connection and hands it to the worker pool
+        void Dispatch(Connection& connection) {
+            if (connection.busy || !connection.out.empty())
+                return;
+            size_t end = connection.in.find("\r\n\r\n");
+            if (end == string::npos) {
+                if (connection.in.size() > kMaxRequestBytes)
+                    Close(connection.fd);
+                return;
+            }
+            string head = connection.in.substr(0, end);
+            connection.in.erase(0, end + 4);
+
+            size_t method_end = head.find(' ');
+            size_t target_end = head.find(' ', method_end + 1);
+            if (method_end == string::npos || target_end == string::npos) {
+                Respond(connection, "400 Bad Request", "text/plain", "Bad request\n", false);
+                return;
+            }
+            string method = head.substr(0, method_end);
+            string target = head.substr(method_end + 1, target_end - method_end - 1);
+            string version = head.substr(target_end + 1, head.find("\r\n") - target_end - 1);
+            string lower = head;
+            for (unsigned int i = 0; i < lower.size(); i++)
+                lower[i] = tolower(lower[i]);
+            bool keep_alive = version == "HTTP/1.1"
+                    ? lower.find("\r\nconnection: close") == string::npos
+                    : lower.find("\r\nconnection: keep-alive") != string::npos;
+            if (method != "GET") {
+                Respond(connection, "405 Method Not Allowed", "text/plain", "Only GET is supported\n", keep_alive);
+                return;
+            }
+
+            connection.busy = true;
+            Job job;
+            job.fd = connection.fd;
+            job.id = connection.id;
+            job.target = target;
+            job.keep_alive = keep_alive;
+            {
+                lock_guard<mutex> guard(jobs_lock_);
+                jobs_.push_back(job);
+            }
+            jobs_ready_.notify_one();
+        }
+
+        void Respond(Connection& connection, string const & status, string const & type,
+                string const & body, bool keep_alive) {
+            connection.out = BuildResponse(status, type, body, keep_alive);
+            connection.out_offset = 0;
+            connection.keep_alive = keep_alive;
+            Write(connection.fd);
+        }
+
+        void Write(int fd) {
+            Connection& connection = *connections_[fd];
+            while (connection.out_offset < connection.out.size()) {
+                ssize_t count = write(fd, connection.out.data() + connection.out_offset,
+                        connection.out.size() - connection.out_offset);
+                if (count < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                        Rewatch(fd, EPOLLIN | EPOLLOUT);
+                        return;
+                    }
+                    Close(fd);
+                    return;
+                }
+                connection.out_offset += count;
+            }
+            connection.out.clear();
+            connection.out_offset = 0;
+            if (!connection.keep_alive) {
+                Close(fd);
+                return;
+            }
+            Rewatch(fd, EPOLLIN);
+            Dispatch(connection); // pipelined requests may already be buffered
+        }
+
+        void DrainCompletions() {
+            uint64_t count;
+            while (read(wakeup_, &count, sizeof(count)) > 0) {}
+            deque<Completion> done;
+            {
+                lock_guard<mutex> guard(completions_lock_);
+                done.swap(completions_);
+            }
+            for (unsigned int i = 0; i < done.size(); i++) {
+                map<int, unique_ptr<Connection>>::iterator found = connections_.find(done[i].fd);
+                if (found == connections_.end() || found->second->id != done[i].id)
+                    continue;
+                Connection& connection = *found->second;
+                if (connection.peer_closed) {
+                    Close(connection.fd);
+                    continue;
+                }
+                connection.busy = false;
+                connection.out = done[i].response;
+                connection.out_offset = 0;
+                connection.keep_alive = done[i].keep_alive;
+                Write(connection.fd);
+            }
+        }
+
+        void WorkerLoop() {
+            while (true) {
+                Job job;
+                {
+                    unique_lock<mutex> guard(jobs_lock_);
+                    jobs_ready_.wait(guard, [this] { return stopping_ || !jobs_.empty(); });
+                    if (stopping_)
+                        return;
+                    job = jobs_.front();
+                    jobs_.pop_front();
+                }
+                Completion completion;
+                completion.fd = job.fd;
+                completion.id = job.id;
+                completion.keep_alive = job.keep_alive;
+                completion.response = Handle(job.target, job.keep_alive);
+                {
+                    lock_guard<mutex> guard(completions_lock_);
+                    completions_.push_back(completion);
+                }
+                uint64_t one = 1;
+                ssize_t written = write(wakeup_, &one, sizeof(one));
+                (void) written;
+            }
+        }
+
+        // serves GET /thumbhash/<base64>.png?w=&h=&linear=1, and the stage stats at /metrics and /metrics.json
+        string Handle(string const & target, bool keep_alive) {
+            static const string prefix = "/thumbhash/";
+            size_t query = target.find('?');
+            string path = target.substr(0, query);
+            if (path == "/metrics")
+                return BuildResponse("200 OK", "text/plain; version=0.0.4",
+                        StageStats::Collect().ToPrometheus(), keep_alive);
+            if (path == "/metrics.json")
+                return BuildResponse("200 OK", "application/json",
+                        StageStats::Collect().ToJSON(), keep_alive);
+            if (path.compare(0, prefix.size(), prefix) != 0 || path.size() < prefix.size() + 4
+                    || path.compare(path.size() - 4, 4, ".png") != 0)
+                return BuildResponse("404 Not Found", "text/plain", "Not found\n", keep_alive);
+
+            vector<unsigned char> hash;
+            string encoded = path.substr(prefix.size(), path.size() - prefix.size() - 4);
+            if (!Base64Decode(encoded, hash) || hash.size() > (size_t) ThumbHash::kMaxHashSize || !ThumbHash::IsValidThumbHash(hash))
+                return BuildResponse("400 Bad Request", "text/plain", "Invalid ThumbHash\n", keep_alive);
+
+            unsigned int width = 0, height = 0;
+            bool linear_light = false;
+            if (query != string::npos) {
+                string parameters = "&" + target.substr(query + 1) + "&";
+                linear_light = parameters.find("&linear=1&") != string::npos;
+                size_t w = parameters.find("&w="), h = parameters.find("&h=");
+                if (w != string::npos) width = strtoul(parameters.c_str() + w + 3, nullptr, 10);
+                if (h != string::npos) height = strtoul(parameters.c_str() + h + 3, nullptr, 10);
+                if (width > kMaxSize || height > kMaxSize || (width == 0) != (height == 0))
+                    return BuildResponse("400 Bad Request", "text/plain",
+                            "w and h must be given together, up to 256\n", keep_alive);
+            }
+
+            shared_ptr<const vector<unsigned char>> png = cache_.GetPNG(hash, width, height, linear_light);
+            if (png->empty())
+                return BuildResponse("500 Internal Server Error", "text/plain", "Encoding failed\n", keep_alive);
+            // a placeholder is a pure function of its URL, so only it may be cached for good
+            return BuildResponse("200 OK", "image/png", string(png->begin(), png->end()), keep_alive, true);
+        }
+
+        static string BuildResponse(string const & status, string const & type, string const & body,
+                bool keep_alive, bool immutable = false) {
+            string response = "HTTP/1.1 " + status + "\r\nContent-Type: " + type
+                    + "\r\nContent-Length: " + to_string(body.size())
+                    + (immutable ? "\r\nCache-Control: public, max-age=31536000, immutable" : "\r\nCache-Control: no-store")
+                    + (keep_alive ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n");
+            return response + body;
+        }
+};
+
+int main(int argc, char** argv) {
+    int port = argc > 1 ? atoi(argv[1]) : 8080;
+    int workers = argc > 2 ? atoi(argv[2]) : max(1u, thread::hardware_concurrency());
+    size_t cache_bytes = (argc > 3 ? atoi(argv[3]) : 64) * (size_t) 1024 * 1024;
+    if (workers < 1) {
+        cerr << "usage: th-server [port] [workers, at least 1] [cache MB]" << endl;
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    Server server(workers, cache_bytes);
+    return server.Run(port);
+}
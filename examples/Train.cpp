@@ -0,0 +1,79 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../src/Corpus.h"
+#include "../src/Similarity.h"
+#include "../src/Thumbhash.h"
+
+using namespace std;
+
+// runs every hash path the way a service would: read a PNG, hash it several ways, and render it back
+static size_t Exercise(ThumbHash& th, vector<unsigned char> const & png) {
+    Image image;
+    PixelImage pixels;
+    if (!image.ReadFromMemory(png) || !pixels.ReadFromMemory(png))
+        return 0;
+    size_t work = 0;
+    uint8_t hash[ThumbHash::kMaxHashSize];
+    size_t size = th.RGBAToThumbHash(image, hash);
+    work += th.RGBAToThumbHash(pixels, hash);
+    work += th.RGBAToThumbHashFixedPoint(image, hash);
+    work += th.RGBAToThumbHash(image, hash, true);
+    if (size == 0)
+        return work;
+
+    vector<uint8_t> bytes(hash, hash + size);
+    const unsigned int sizes[] = { 16, 32, 64 };
+    for (unsigned int s = 0; s < 3; s++) {
+        Image decoded = th.ThumbHashToRGBA(bytes, sizes[s], sizes[s]);
+        vector<unsigned char> out;
+        if (decoded.WriteToMemory(out))
+            work += out.size();
+    }
+    work += th.ThumbHashToRGBA(bytes).width_;
+    work += th.ThumbHashToAverageRGBA(bytes).red_;
+    work += (size_t) th.ThumbHashToApproximateAspectRatio(bytes);
+    work += th.ThumbHashToCSSGradient(bytes, 4, 3).size();
+    work += (size_t) (100 * ThumbHashDistance(bytes, bytes));
+    return work;
+}
+
+int main(int argc, char** argv) {
+    string root = argc > 1 ? argv[1] : "examples/images-original";
+    ThumbHash th;
+    size_t work = 0;
+    unsigned int images = 0;
+
+    // the bundled photos
+    const char* names[] = { "bart", "flower", "shark" };
+    for (unsigned int i = 0; i < 3; i++) {
+        Image image;
+        if (!image.ReadFromFile(root + "/" + names[i] + ".png"))
+            return 1;
+        vector<unsigned char> png;
+        image.WriteToMemory(png);
+        work += Exercise(th, png);
+        images++;
+    }
+
+    // generated content across sizes, alpha modes and every PNG colour type
+    static const unsigned int sizes[][2] = {
+        { 8, 8 }, { 32, 32 }, { 64, 48 }, { 100, 100 }, { 256, 192 }, { 17, 300 }, { 1000, 1 }, { 1, 1000 }, { 640, 480 }
+    };
+    CorpusGenerator generator(1);
+    for (unsigned int i = 0; i < 9 * CorpusGenerator::kPatterns * 3; i++) {
+        CorpusPattern pattern = (CorpusPattern) (i % CorpusGenerator::kPatterns);
+        CorpusEncoding encoding = (CorpusEncoding) ((i * 7) % CorpusGenerator::kEncodings);
+        unsigned int const * size = sizes[i / CorpusGenerator::kPatterns % 9];
+        vector<unsigned char> png;
+        ImageStatus status;
+        if (CorpusGenerator::EncodePNG(generator.Generate(pattern, size[0], size[1], i), size[0], size[1],
+                encoding, png, status)) {
+            work += Exercise(th, png);
+            images++;
+        }
+    }
+    cout << "trained on " << images << " images (" << work << ")" << endl;
+    return 0;
+}
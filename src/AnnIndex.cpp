@@ -0,0 +1,230 @@
+#include "AnnIndex.h"
+#include "Thumbhash.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char kMagic[8] = { 'T', 'H', 'A', 'N', 'N', 'I', 'X', '\0' };
+static const uint32_t kVersion = 1;
+static const size_t kHeaderSize = 24;
+static const size_t kRecordSize = 32;
+static const size_t kRecordsOffset = kHeaderSize + (AnnIndex::kBuckets + 1) * 8;
+
+const int AnnIndex::kColourBits;
+const int AnnIndex::kBuckets;
+
+static void PutLittleEndian(unsigned char* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out[i] = (unsigned char) (value >> (8 * i));
+}
+
+static uint64_t GetLittleEndian(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t) in[i] << (8 * i);
+    return value;
+}
+
+static bool Closer(Neighbour const & a, Neighbour const & b) {
+    return a.distance_ < b.distance_ || (a.distance_ == b.distance_ && a.index_ < b.index_);
+}
+
+AnnIndex::AnnIndex() {
+    inserted_count_ = 0;
+    data_           = nullptr;
+    size_           = 0;
+    mapped_count_   = 0;
+}
+
+AnnIndex::~AnnIndex() {
+    Close();
+}
+
+uint32_t AnnIndex::BucketOf(vector<uint8_t> const & hash) {
+    ThumbHashHeader header;
+    header.Parse(hash.data(), hash.size());
+    int shift = 6 - kColourBits;
+    uint32_t l = header.l_code_ >> shift;
+    uint32_t p = header.p_code_ >> shift;
+    uint32_t q = header.q_code_ >> shift;
+    uint32_t aspect = (header.has_alpha_ ? 1 : 0) | (header.is_landscape_ ? 2 : 0) | (header.order_ << 2);
+    return (((aspect << kColourBits | l) << kColourBits | p) << kColourBits) | q;
+}
+
+bool AnnIndex::Insert(uint32_t id, vector<uint8_t> const & hash) {
+    HashVector unpacked;
+    if (hash.size() > 25 || !unpacked.Unpack(hash))
+        return false;
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.id = id;
+    record.length = (uint8_t) hash.size();
+    copy(hash.begin(), hash.end(), record.hash);
+    inserted_[BucketOf(hash)].push_back(record);
+    inserted_count_++;
+    return true;
+}
+
+vector<Neighbour> AnnIndex::Search(vector<uint8_t> const & query, size_t k, int radius) const {
+    HashVector unpacked;
+    vector<Neighbour> best;
+    if (k == 0 || !unpacked.Unpack(query))
+        return best;
+
+    uint32_t bucket = BucketOf(query);
+    uint32_t mask = (1 << kColourBits) - 1;
+    int l = (bucket >> (2 * kColourBits)) & mask, p = (bucket >> kColourBits) & mask, q = bucket & mask;
+    uint32_t aspect = bucket >> (3 * kColourBits);
+    for (int dl = max(0, l - radius); dl <= min((int) mask, l + radius); dl++)
+        for (int dp = max(0, p - radius); dp <= min((int) mask, p + radius); dp++)
+            for (int dq = max(0, q - radius); dq <= min((int) mask, q + radius); dq++)
+                ScanBucket((((aspect << kColourBits | dl) << kColourBits | dp) << kColourBits) | dq,
+                        unpacked, k, best);
+    sort(best.begin(), best.end(), Closer);
+    return best;
+}
+
+void AnnIndex::ScanBucket(uint32_t bucket, HashVector const & query, size_t k,
+        vector<Neighbour>& best) const {
+    vector<uint8_t> candidate;
+    HashVector unpacked;
+    const unsigned char* offsets = data_ ? data_ + kHeaderSize : nullptr;
+    size_t begin = data_ ? GetLittleEndian(offsets + bucket * 8, 8) : 0;
+    size_t end = data_ ? GetLittleEndian(offsets + (bucket + 1) * 8, 8) : 0;
+    map<uint32_t, vector<Record>>::const_iterator inserted = inserted_.find(bucket);
+    size_t extra = inserted == inserted_.end() ? 0 : inserted->second.size();
+
+    // mapped records first, then the in-memory layer
+    for (size_t i = begin; i < end + extra; i++) {
+        uint32_t id;
+        if (i < end) {
+            const unsigned char* record = data_ + kRecordsOffset + i * kRecordSize;
+            id = GetLittleEndian(record, 4);
+            candidate.assign(record + 5, record + 5 + min((int) record[4], 25));
+        } else {
+            Record const & record = inserted->second[i - end];
+            id = record.id;
+            candidate.assign(record.hash, record.hash + record.length);
+        }
+        if (!unpacked.Unpack(candidate))
+            continue;
+        float distance = query.SquaredDistance(unpacked);
+        if (best.size() == k && distance >= best.front().distance_)
+            continue;
+        best.push_back(Neighbour(id, distance));
+        push_heap(best.begin(), best.end(), Closer);
+        if (best.size() > k) {
+            pop_heap(best.begin(), best.end(), Closer);
+            best.pop_back();
+        }
+    }
+}
+
+bool AnnIndex::WriteToFile(string const & fileName, FileStatus& status) {
+    uint64_t count = Size();
+    vector<unsigned char> head(kRecordsOffset, 0);
+    memcpy(&head[0], kMagic, sizeof(kMagic));
+    PutLittleEndian(&head[8], kVersion, 4);
+    PutLittleEndian(&head[12], kBuckets, 4);
+    PutLittleEndian(&head[16], count, 8);
+
+    // merge the mapped buckets with the inserted ones, bucket by bucket
+    vector<unsigned char> records;
+    records.reserve(count * kRecordSize);
+    for (uint32_t bucket = 0; bucket < (uint32_t) kBuckets; bucket++) {
+        PutLittleEndian(&head[kHeaderSize + bucket * 8], records.size() / kRecordSize, 8);
+        if (data_) {
+            size_t begin = GetLittleEndian(data_ + kHeaderSize + bucket * 8, 8);
+            size_t end = GetLittleEndian(data_ + kHeaderSize + (bucket + 1) * 8, 8);
+            records.insert(records.end(), data_ + kRecordsOffset + begin * kRecordSize,
+                    data_ + kRecordsOffset + end * kRecordSize);
+        }
+        map<uint32_t, vector<Record>>::const_iterator inserted = inserted_.find(bucket);
+        if (inserted == inserted_.end())
+            continue;
+        for (unsigned int i = 0; i < inserted->second.size(); i++) {
+            unsigned char record[kRecordSize] = { 0 };
+            PutLittleEndian(record, inserted->second[i].id, 4);
+            record[4] = inserted->second[i].length;
+            memcpy(record + 5, inserted->second[i].hash, 25);
+            records.insert(records.end(), record, record + kRecordSize);
+        }
+    }
+    PutLittleEndian(&head[kHeaderSize + kBuckets * 8], count, 8);
+
+    // the open file may be the target, so never truncate it under its mapping: write a new
+    // file beside it and rename it into place, then map the merged file in place of both layers
+    string temporary = fileName + ".tmp";
+    ofstream out(temporary.c_str(), ios::binary | ios::trunc);
+    out.write((const char*) &head[0], head.size());
+    if (!records.empty())
+        out.write((const char*) &records[0], records.size());
+    out.close();
+    if (!out || rename(temporary.c_str(), fileName.c_str()) != 0) {
+        status = FileStatus(FileError::kWrite, fileName, "");
+        remove(temporary.c_str());
+        return false;
+    }
+    return Open(fileName, status);
+}
+
+bool AnnIndex::Open(string const & fileName, FileStatus& status) {
+    Close();
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        status = FileStatus(FileError::kOpen, fileName, strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < kRecordsOffset) {
+        status = FileStatus(FileError::kRead, fileName, "too short for an ANN index");
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        status = FileStatus(FileError::kMap, fileName, strerror(errno));
+        return false;
+    }
+    data_ = (const unsigned char*) mapped;
+    size_ = info.st_size;
+
+    uint64_t count = GetLittleEndian(data_ + 16, 8);
+    bool valid = memcmp(data_, kMagic, sizeof(kMagic)) == 0 && GetLittleEndian(data_ + 8, 4) == kVersion
+            && GetLittleEndian(data_ + 12, 4) == (uint64_t) kBuckets
+            && size_ == kRecordsOffset + count * kRecordSize;
+    for (uint32_t bucket = 0; valid && bucket < (uint32_t) kBuckets; bucket++)
+        valid = GetLittleEndian(data_ + kHeaderSize + bucket * 8, 8)
+                <= GetLittleEndian(data_ + kHeaderSize + (bucket + 1) * 8, 8);
+    if (!valid || GetLittleEndian(data_ + kHeaderSize + kBuckets * 8, 8) != count) {
+        status = FileStatus(FileError::kFormat, fileName, "not an ANN index header");
+        Close();
+        return false;
+    }
+    mapped_count_ = count;
+    status = FileStatus();
+    return true;
+}
+
+void AnnIndex::Close() {
+    if (data_)
+        munmap((void*) data_, size_);
+    data_           = nullptr;
+    size_           = 0;
+    mapped_count_   = 0;
+    inserted_.clear();
+    inserted_count_ = 0;
+}
+
+size_t AnnIndex::Size() const {
+    return mapped_count_ + inserted_count_;
+}
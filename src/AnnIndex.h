@@ -0,0 +1,118 @@
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "FileStatus.h"
+#include "HashIndex.h"
+#ifndef _ANNINDEX_H_
+#define _ANNINDEX_H_
+
+using namespace std;
+
+/*
+ * Inverted-file index over ThumbHashes. The first level buckets hashes on their header:
+ * the quantized average L, P and Q (the values ThumbHashToAverageRGBA decodes) and the
+ * aspect fields ThumbHashToApproximateAspectRatio reads. A query probes its own bucket and,
+ * with a radius, the neighbouring colour cells, then ranks those candidates exactly in the
+ * AC domain with HashVector.
+ * 
+ * On-disk layout, all integers little-endian:
+ * 
+ *   header    magic "THANNIX\0", uint32 version, uint32 bucket count, uint64 record count
+ *   offsets   bucket count + 1 uint64 record indexes, bucket b is [offsets[b], offsets[b + 1])
+ *   records   uint32 id, uint8 hash length, 25 hash bytes, 2 bytes of padding
+*/
+
+class AnnIndex {
+    public:
+        static const int kColourBits = 3; /* bits kept of each 6-bit average L, P and Q */
+        static const int kBuckets = 1 << (5 + 3 * kColourBits); /* 5 aspect bits, 3 colours */
+
+        /**
+         * Constructs an empty index.
+        */
+        AnnIndex();
+
+        /**
+         * Unmaps the index file, if one is open.
+        */
+        ~AnnIndex();
+
+        /**
+         * Adds a hash. Inserts go to an in-memory layer on top of any mapped file.
+         * 
+         * @param id - the caller's identifier for the hash, returned by searches
+         * @param hash - the unsigned 8-bit integer array
+         * @return true, if the hash was valid and has been added.
+        */
+        bool Insert(uint32_t id, vector<uint8_t> const & hash);
+
+        /**
+         * Finds approximately the k hashes closest to a query.
+         * 
+         * @param query - the unsigned 8-bit integer array
+         * @param k - the number of neighbours to return
+         * @param radius - how many colour cells to probe around the query's bucket, 0 or more
+         * @returns up to k neighbours, closest first, with index_ set to the inserted id
+        */
+        vector<Neighbour> Search(vector<uint8_t> const & query, size_t k, int radius) const;
+
+        /**
+         * Writes every hash, mapped and inserted, to a file that Open can map, then maps it
+         * in place of the old file and the in-memory layer. The file is written beside the
+         * target and renamed over it, so the mapped file is never truncated underneath readers.
+         * 
+         * @param fileName - name of the file to be written.
+         * @param status - receives why it failed
+         * @return true, if the index was successfully written and reopened.
+        */
+        bool WriteToFile(string const & fileName, FileStatus& status);
+
+        /**
+         * Memory-maps an index file and drops any in-memory inserts.
+         * 
+         * @param fileName - name of the file to be opened.
+         * @param status - receives why it failed
+         * @return true, if the file was mapped and its header is valid.
+        */
+        bool Open(string const & fileName, FileStatus& status);
+
+        /**
+         * Unmaps the index file and drops every hash.
+        */
+        void Close();
+
+        /**
+         * @returns the number of hashes, mapped and inserted
+        */
+        size_t Size() const;
+
+        /**
+         * Computes the first-level bucket of a hash from its header alone.
+         * 
+         * @param hash - the unsigned 8-bit integer array, at least 5 bytes
+         * @returns the bucket, less than kBuckets
+        */
+        static uint32_t BucketOf(vector<uint8_t> const & hash);
+
+    private:
+        struct Record {
+            uint32_t id;
+            uint8_t length;
+            uint8_t hash[25];
+        };
+
+        map<uint32_t, vector<Record>> inserted_; /* the in-memory layer, by bucket */
+        size_t inserted_count_;
+        const unsigned char* data_; /* the mapped file, or nullptr */
+        size_t size_;
+        size_t mapped_count_;
+
+        void ScanBucket(uint32_t bucket, HashVector const & query, size_t k,
+                vector<Neighbour>& best) const;
+
+        AnnIndex(AnnIndex const &);
+        AnnIndex& operator=(AnnIndex const &);
+};
+
+#endif
@@ -0,0 +1,62 @@
+#include "Base64.h"
+
+using namespace std;
+
+static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+string Base64Encode(vector<unsigned char> const & bytes) {
+    string text;
+    text.reserve((bytes.size() + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 2 < bytes.size(); i += 3) {
+        unsigned int group = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+        text += kAlphabet[(group >> 18) & 63];
+        text += kAlphabet[(group >> 12) & 63];
+        text += kAlphabet[(group >> 6) & 63];
+        text += kAlphabet[group & 63];
+    }
+    if (i < bytes.size()) {
+        bool has_second = i + 1 < bytes.size();
+        unsigned int group = (bytes[i] << 16) | (has_second ? bytes[i + 1] << 8 : 0);
+        text += kAlphabet[(group >> 18) & 63];
+        text += kAlphabet[(group >> 12) & 63];
+        text += has_second ? kAlphabet[(group >> 6) & 63] : '=';
+        text += '=';
+    }
+    return text;
+}
+
+// maps a base64 character to its 6-bit value, or -1 if it is not in either alphabet
+static int DecodeCharacter(char c) {
+    if (c >= 'A' && c <= 'Z') return c - 'A';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+    if (c >= '0' && c <= '9') return c - '0' + 52;
+    if (c == '+' || c == '-') return 62;
+    if (c == '/' || c == '_') return 63;
+    return -1;
+}
+
+bool Base64Decode(string const & text, vector<unsigned char>& bytes) {
+    size_t length = text.size();
+    while (length > 0 && text[length - 1] == '=')
+        length--;
+    if (length % 4 == 1 || text.size() - length > 2)
+        return false;
+
+    bytes.clear();
+    bytes.reserve(length * 3 / 4);
+    unsigned int group = 0;
+    int bits = 0;
+    for (size_t i = 0; i < length; i++) {
+        int value = DecodeCharacter(text[i]);
+        if (value < 0)
+            return false;
+        group = (group << 6) | value;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            bytes.push_back((unsigned char) (group >> bits));
+        }
+    }
+    return true;
+}
@@ -0,0 +1,26 @@
+#include <string>
+#include <vector>
+#ifndef _BASE64_H_
+#define _BASE64_H_
+
+using namespace std;
+
+/**
+ * Encodes bytes as standard, padded base64.
+ * 
+ * @param bytes - the bytes to be encoded
+ * @returns the base64 text
+*/
+string Base64Encode(vector<unsigned char> const & bytes);
+
+/**
+ * Decodes base64 text. Both the standard and the URL-safe alphabets are accepted,
+ * and the trailing padding is optional.
+ * 
+ * @param text - the base64 text
+ * @param bytes - the buffer that receives the decoded bytes
+ * @returns true, if the text was valid base64
+*/
+bool Base64Decode(string const & text, vector<unsigned char>& bytes);
+
+#endif
@@ -0,0 +1,212 @@
+#include "BatchDecoder.h"
+#include "Thumbhash.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// the highest DCT order any channel can use (lx and ly are 3 bits)
+static const int kMaxOrder = 8;
+
+// below this many tiles per thread the batch is decoded on the calling thread
+static const size_t kTilesPerThread = 32;
+
+Atlas::Atlas() {
+    tile_width_     = 0;
+    tile_height_    = 0;
+    columns_        = 0;
+    rows_           = 0;
+    width_          = 0;
+    height_         = 0;
+}
+
+size_t Atlas::TileOffset(unsigned int index) const {
+    size_t column = index % columns_;
+    size_t row = index / columns_;
+    return row * tile_height_ * Stride() + column * tile_width_ * 4;
+}
+
+size_t Atlas::Stride() const {
+    return (size_t) width_ * 4;
+}
+
+BatchDecoder::BatchDecoder(unsigned int tile_width, unsigned int tile_height, unsigned int threads) {
+    tile_width_ = max(1u, tile_width);
+    tile_height_ = max(1u, tile_height);
+    threads_ = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+
+    // every tile has the same size, so the cosine terms are shared by the whole batch
+    fx_ = vector<float>(kMaxOrder * tile_width_);
+    fy_ = vector<float>(kMaxOrder * tile_height_);
+    for (int cx = 0; cx < kMaxOrder; cx++)
+        for (unsigned int x = 0; x < tile_width_; x++)
+            fx_[cx * tile_width_ + x] = (float) cos(M_PI / tile_width_ * (x + 0.5f) * cx);
+    for (int cy = 0; cy < kMaxOrder; cy++)
+        for (unsigned int y = 0; y < tile_height_; y++)
+            fy_[cy * tile_height_ + y] = (float) cos(M_PI / tile_height_ * (y + 0.5f) * cy) * 2.0f;
+
+    // the calling thread decodes a slice of every batch, so the pool holds one thread fewer
+    stopping_ = false;
+    for (unsigned int i = 1; i < threads_; i++)
+        pool_.push_back(thread(&BatchDecoder::WorkerLoop, this));
+}
+
+BatchDecoder::~BatchDecoder() {
+    {
+        lock_guard<mutex> guard(lock_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    for (unsigned int i = 0; i < pool_.size(); i++)
+        pool_[i].join();
+}
+
+void BatchDecoder::WorkerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> guard(lock_);
+            ready_.wait(guard, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty())
+                return;
+            task = tasks_.front();
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+Atlas BatchDecoder::Decode(vector<vector<uint8_t>> const & hashes, unsigned int columns) const {
+    return Decode(hashes, columns, false);
+}
+
+Atlas BatchDecoder::Decode(vector<vector<uint8_t>> const & hashes, unsigned int columns,
+        bool linear_light) const {
+    Atlas atlas;
+    atlas.tile_width_ = tile_width_;
+    atlas.tile_height_ = tile_height_;
+    atlas.columns_ = max(1u, min(columns, (unsigned int) max((size_t) 1, hashes.size())));
+    atlas.rows_ = (hashes.size() + atlas.columns_ - 1) / atlas.columns_;
+    atlas.width_ = atlas.columns_ * tile_width_;
+    atlas.height_ = atlas.rows_ * tile_height_;
+    atlas.rgba_ = vector<unsigned char>(atlas.Stride() * atlas.height_);
+
+    size_t workers = min((size_t) threads_, hashes.size() / kTilesPerThread);
+    if (workers <= 1) {
+        DecodeRange(hashes, atlas, 0, hashes.size(), linear_light);
+        return atlas;
+    }
+
+    // tiles never overlap, so each slice writes its own part of the atlas without locking;
+    // the pool decodes every slice but the first, which the calling thread decodes meanwhile
+    size_t chunk = (hashes.size() + workers - 1) / workers;
+    mutex done_lock;
+    condition_variable done;
+    size_t pending = (hashes.size() - 1) / chunk;
+    {
+        lock_guard<mutex> guard(lock_);
+        for (size_t begin = chunk; begin < hashes.size(); begin += chunk) {
+            size_t end = min(hashes.size(), begin + chunk);
+            tasks_.push_back([this, &hashes, &atlas, begin, end, linear_light, &done_lock, &done, &pending] {
+                DecodeRange(hashes, atlas, begin, end, linear_light);
+                lock_guard<mutex> finished(done_lock);
+                if (--pending == 0)
+                    done.notify_one();
+            });
+        }
+    }
+    ready_.notify_all();
+    DecodeRange(hashes, atlas, 0, chunk, linear_light);
+    unique_lock<mutex> guard(done_lock);
+    done.wait(guard, [&pending] { return pending == 0; });
+    return atlas;
+}
+
+void BatchDecoder::DecodeRange(vector<vector<uint8_t>> const & hashes, Atlas& atlas,
+        size_t begin, size_t end, bool linear_light) const {
+    vector<float> scratch(4 * tile_width_);
+    for (size_t i = begin; i < end; i++)
+        DecodeTile(hashes[i], &atlas.rgba_[atlas.TileOffset(i)], atlas.Stride(), &scratch[0], linear_light);
+}
+
+// adds the contribution of every (cx, cy) term of row y into the per-cx row weights
+static void AccumulateRow(float const *ac, int nx, int ny, float const *fy, unsigned int height,
+        unsigned int y, float *row) {
+    fill(row, row + kMaxOrder, 0.0f);
+    for (int cy = 0, j = 0; cy < ny; cy++) {
+        float fy2 = fy[cy * height + y];
+        for (int cx = cy > 0 ? 0 : 1; cx * ny < nx * (ny - cy); cx++, j++)
+            row[cx] += ac[j] * fy2;
+    }
+}
+
+// expands the per-cx row weights into one value per pixel of the row
+static void ExpandRow(float dc, float const *row, int nx, float const *fx, unsigned int width,
+        float *out) {
+    for (unsigned int x = 0; x < width; x++)
+        out[x] = dc;
+    for (int cx = 0; cx < nx; cx++) {
+        float weight = row[cx];
+        float const *fxc = fx + cx * width;
+        for (unsigned int x = 0; x < width; x++)
+            out[x] += weight * fxc[x];
+    }
+}
+
+void BatchDecoder::DecodeTile(vector<uint8_t> const & hash, unsigned char* out, size_t stride,
+        float* scratch, bool linear_light) const {
+    ThumbHashHeader header;
+    if (!header.Parse(hash.data(), hash.size()) || hash.size() < header.HashSize())
+        return;
+    bool has_alpha = header.has_alpha_;
+    int lx = header.lx_, ly = header.ly_;
+    float l_dc = header.l_dc_, p_dc = header.p_dc_, q_dc = header.q_dc_, a_dc = header.a_dc_;
+
+    // dequantize straight onto the stack, as ThumbHashToRGBA does, so a tile allocates nothing
+    int l_count = Channel::CountAC(lx, ly), pq_count = Channel::CountAC(3, 3);
+    float l_ac[7 * 7], p_ac[3 * 3], q_ac[3 * 3], a_ac[5 * 5];
+    const uint8_t* ac = &hash[header.ac_start_];
+    Channel::DequantizeNibbles(ac, 0, l_count, header.l_scale_, l_ac);
+    Channel::DequantizeNibbles(ac, l_count, pq_count, header.p_scale_ * 1.25f, p_ac);
+    Channel::DequantizeNibbles(ac, l_count + pq_count, pq_count, header.q_scale_ * 1.25f, q_ac);
+    if (has_alpha)
+        Channel::DequantizeNibbles(ac, l_count + 2 * pq_count, Channel::CountAC(5, 5), header.a_scale_, a_ac);
+
+    // the DCT is separable: collapse the cy terms per row, then sweep the row with the cx terms
+    float *l = scratch, *p = l + tile_width_, *q = p + tile_width_, *a = q + tile_width_;
+    float l_row[kMaxOrder], p_row[kMaxOrder], q_row[kMaxOrder], a_row[kMaxOrder];
+    for (unsigned int y = 0; y < tile_height_; y++) {
+        AccumulateRow(l_ac, lx, ly, &fy_[0], tile_height_, y, l_row);
+        AccumulateRow(p_ac, 3, 3, &fy_[0], tile_height_, y, p_row);
+        AccumulateRow(q_ac, 3, 3, &fy_[0], tile_height_, y, q_row);
+        ExpandRow(l_dc, l_row, lx, &fx_[0], tile_width_, l);
+        ExpandRow(p_dc, p_row, 3, &fx_[0], tile_width_, p);
+        ExpandRow(q_dc, q_row, 3, &fx_[0], tile_width_, q);
+        if (has_alpha) {
+            AccumulateRow(a_ac, 5, 5, &fy_[0], tile_height_, y, a_row);
+            ExpandRow(a_dc, a_row, 5, &fx_[0], tile_width_, a);
+        } else {
+            fill(a, a + tile_width_, 1.0f);
+        }
+
+        // convert to RGB
+        unsigned char *pixel = out + y * stride;
+        for (unsigned int x = 0; x < tile_width_; x++, pixel += 4) {
+            float b = l[x] - 2.0f / 3.0f * p[x];
+            float r = (3.0f * l[x] - b + q[x]) / 2.0f;
+            float g = r - q[x];
+            if (linear_light) {
+                pixel[0] = ThumbHash::LinearToSRGB(r);
+                pixel[1] = ThumbHash::LinearToSRGB(g);
+                pixel[2] = ThumbHash::LinearToSRGB(b);
+            } else {
+                pixel[0] = (unsigned char) max(0.0f, round(255.0f * min(1.0f, r)));
+                pixel[1] = (unsigned char) max(0.0f, round(255.0f * min(1.0f, g)));
+                pixel[2] = (unsigned char) max(0.0f, round(255.0f * min(1.0f, b)));
+            }
+            pixel[3] = (unsigned char) max(0.0f, round(255.0f * min(1.0f, a[x])));
+        }
+    }
+}
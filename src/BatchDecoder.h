@@ -0,0 +1,108 @@
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifndef _BATCHDECODER_H_
+#define _BATCHDECODER_H_
+
+using namespace std;
+
+class Atlas {
+    public:
+        unsigned int tile_width_; /* the width of each tile */
+        unsigned int tile_height_; /* the height of each tile */
+        unsigned int columns_; /* the number of tiles per atlas row */
+        unsigned int rows_; /* the number of tile rows */
+        unsigned int width_; /* the width of the atlas, columns * tile width */
+        unsigned int height_; /* the height of the atlas, rows * tile height */
+        vector<unsigned char> rgba_; /* the RGBA bytes of the atlas, row by row */
+
+        /**
+         * Constructs an empty Atlas.
+        */
+        Atlas();
+
+        /**
+         * Computes the byte offset of the top-left pixel of a tile.
+         * 
+         * @param index - the index of the tile, in the order the hashes were given
+         * @returns the offset into rgba_
+        */
+        size_t TileOffset(unsigned int index) const;
+
+        /**
+         * Computes the number of bytes between two rows of the atlas.
+         * 
+         * @returns the row stride in bytes
+        */
+        size_t Stride() const;
+};
+
+class BatchDecoder {
+    public:
+        /**
+         * Constructs a batch decoder that renders every hash at a fixed tile size.
+         * The worker threads are started here and kept until destruction, so large batches
+         * never create threads; the calling thread decodes one slice of each batch itself.
+         * 
+         * @param tile_width - the width of each decoded tile
+         * @param tile_height - the height of each decoded tile
+         * @param threads - the number of threads for large batches, the caller included,
+         *                  or 0 to use all cores
+        */
+        BatchDecoder(unsigned int tile_width, unsigned int tile_height, unsigned int threads);
+
+        /**
+         * Stops the worker threads.
+        */
+        ~BatchDecoder();
+
+        /**
+         * Decodes many ThumbHashes into one contiguous RGBA atlas.
+         * Tile i is placed at column (i % columns) and row (i / columns); with one column,
+         * the tiles are laid out back to back with a fixed stride.
+         * Hashes that are too short leave their tile fully transparent.
+         * 
+         * @param hashes - the unsigned 8-bit integer arrays
+         * @param columns - the number of tiles per atlas row
+         * @returns the decoded atlas
+        */
+        Atlas Decode(vector<vector<uint8_t>> const & hashes, unsigned int columns) const;
+
+        /**
+         * Decodes many ThumbHashes into one contiguous RGBA atlas, optionally from linear light.
+         * 
+         * @param hashes - the unsigned 8-bit integer arrays
+         * @param columns - the number of tiles per atlas row
+         * @param linear_light - true if the hashes were encoded with linear_light set
+         * @returns the decoded atlas
+        */
+        Atlas Decode(vector<vector<uint8_t>> const & hashes, unsigned int columns, bool linear_light) const;
+
+    private:
+        unsigned int tile_width_;
+        unsigned int tile_height_;
+        unsigned int threads_;
+        vector<float> fx_; /* cos(pi / width * (x + 0.5) * cx), indexed [cx * tile_width + x] */
+        vector<float> fy_; /* 2 * cos(pi / height * (y + 0.5) * cy), indexed [cy * tile_height + y] */
+        vector<thread> pool_; /* threads_ - 1 workers, shared by concurrent Decode calls */
+        mutable mutex lock_;
+        mutable condition_variable ready_;
+        mutable deque<function<void()>> tasks_; /* slices waiting for a worker */
+        bool stopping_;
+
+        void WorkerLoop();
+
+        void DecodeRange(vector<vector<uint8_t>> const & hashes, Atlas& atlas,
+                size_t begin, size_t end, bool linear_light) const;
+        void DecodeTile(vector<uint8_t> const & hash, unsigned char* out, size_t stride,
+                float* scratch, bool linear_light) const;
+
+        BatchDecoder(BatchDecoder const &);
+        BatchDecoder& operator=(BatchDecoder const &);
+};
+
+#endif
@@ -0,0 +1,328 @@
+#include "Corpus.h"
+#include "../util/lodepng/Lodepng.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+
+using namespace std;
+
+const unsigned int CorpusGenerator::kPatterns;
+const unsigned int CorpusGenerator::kEncodings;
+
+// the SplitMix64 finalizer: spreads any change in the input over every output bit
+static uint64_t Mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+    return x ^ (x >> 31);
+}
+
+// a SplitMix64 stream, so every image draws the same numbers on every platform
+class Random {
+    public:
+        uint64_t state_;
+
+        Random(uint64_t seed) {
+            state_ = seed;
+        }
+
+        uint64_t Next() {
+            state_ += 0x9e3779b97f4a7c15ull;
+            return Mix(state_);
+        }
+
+        // uniform in [0, 1)
+        float Uniform() {
+            return (Next() >> 40) / 16777216.0f;
+        }
+};
+
+static float Clamp(float value) {
+    return min(1.0f, max(0.0f, value));
+}
+
+// fills rgb with a sum of waves whose amplitude falls as 1/f, normalized to [0, 1]
+static void DrawPhoto(Random& random, unsigned int width, unsigned int height, bool grey, vector<float>& rgba) {
+    const int kWaves = 24;
+    float frequency[kWaves], dx[kWaves], dy[kWaves], phase[kWaves], weight[kWaves][3];
+    for (int w = 0; w < kWaves; w++) {
+        float u = random.Uniform();
+        frequency[w] = 1.0f + 31.0f * u * u; // cycles across the image, mostly low
+        float angle = 6.2831853f * random.Uniform();
+        dx[w] = frequency[w] * cos(angle) / width;
+        dy[w] = frequency[w] * sin(angle) / height;
+        phase[w] = 6.2831853f * random.Uniform();
+        for (int c = 0; c < 3; c++)
+            weight[w][c] = (grey ? 1.0f : 0.7f + 0.6f * random.Uniform()) / frequency[w];
+    }
+    float tint[3];
+    for (int c = 0; c < 3; c++)
+        tint[c] = grey ? 0.5f : 0.3f + 0.4f * random.Uniform();
+
+    float low = 1e30f, high = -1e30f;
+    for (unsigned int y = 0; y < height; y++)
+        for (unsigned int x = 0; x < width; x++) {
+            float* pixel = &rgba[(x + y * width) * 4];
+            pixel[0] = pixel[1] = pixel[2] = 0;
+            for (int w = 0; w < kWaves; w++) {
+                float wave = sin(6.2831853f * (dx[w] * x + dy[w] * y) + phase[w]);
+                for (int c = 0; c < 3; c++)
+                    pixel[c] += weight[w][c] * wave;
+            }
+            for (int c = 0; c < 3; c++) {
+                low = min(low, pixel[c]);
+                high = max(high, pixel[c]);
+            }
+        }
+    float range = high > low ? high - low : 1.0f;
+    for (unsigned int i = 0; i < width * height; i++)
+        for (int c = 0; c < 3; c++)
+            rgba[i * 4 + c] = Clamp(tint[c] + 0.9f * ((rgba[i * 4 + c] - low) / range - 0.5f));
+}
+
+// composites a few soft-edged ellipses over a fully transparent background
+static void DrawSprite(Random& random, unsigned int width, unsigned int height, vector<float>& rgba) {
+    fill(rgba.begin(), rgba.end(), 0.0f);
+    int shapes = 1 + random.Next() % 4;
+    for (int s = 0; s < shapes; s++) {
+        float cx = width * (0.2f + 0.6f * random.Uniform()), cy = height * (0.2f + 0.6f * random.Uniform());
+        float rx = max(0.5f, width * (0.1f + 0.3f * random.Uniform()));
+        float ry = max(0.5f, height * (0.1f + 0.3f * random.Uniform()));
+        float colour[3] = { random.Uniform(), random.Uniform(), random.Uniform() };
+        float opacity = 0.6f + 0.4f * random.Uniform();
+        float edge = min(rx, ry); // about one pixel of anti-aliasing
+        for (unsigned int y = 0; y < height; y++)
+            for (unsigned int x = 0; x < width; x++) {
+                float ex = (x + 0.5f - cx) / rx, ey = (y + 0.5f - cy) / ry;
+                float alpha = opacity * Clamp((1.0f - sqrt(ex * ex + ey * ey)) * edge + 0.5f);
+                if (alpha <= 0)
+                    continue;
+                float* pixel = &rgba[(x + y * width) * 4];
+                float out = alpha + pixel[3] * (1.0f - alpha);
+                for (int c = 0; c < 3; c++)
+                    pixel[c] = (colour[c] * alpha + pixel[c] * pixel[3] * (1.0f - alpha)) / out;
+                pixel[3] = out;
+            }
+    }
+}
+
+CorpusGenerator::CorpusGenerator(uint64_t seed) {
+    seed_ = seed;
+}
+
+vector<float> CorpusGenerator::Generate(CorpusPattern pattern, unsigned int width, unsigned int height,
+        uint64_t index) const {
+    Random random(Mix(seed_ ^ Mix(index ^ ((uint64_t) pattern << 56) ^ ((uint64_t) width << 32) ^ height)));
+    vector<float> rgba(width * height * 4, 1.0f);
+    switch (pattern) {
+        case CorpusPattern::kGradient: {
+            float from[3], to[3];
+            for (int c = 0; c < 3; c++) {
+                from[c] = random.Uniform();
+                to[c] = random.Uniform();
+            }
+            float angle = 6.2831853f * random.Uniform();
+            float ux = cos(angle), uy = sin(angle), reach = 0.5f * (abs(ux) + abs(uy));
+            for (unsigned int y = 0; y < height; y++)
+                for (unsigned int x = 0; x < width; x++) {
+                    float t = Clamp(0.5f + ((x + 0.5f) / width - 0.5f) * ux / (2 * reach)
+                            + ((y + 0.5f) / height - 0.5f) * uy / (2 * reach));
+                    for (int c = 0; c < 3; c++)
+                        rgba[(x + y * width) * 4 + c] = from[c] + (to[c] - from[c]) * t;
+                }
+            break;
+        }
+        case CorpusPattern::kNoise:
+            for (unsigned int i = 0; i < width * height; i++)
+                for (int c = 0; c < 3; c++)
+                    rgba[i * 4 + c] = random.Uniform();
+            break;
+        case CorpusPattern::kPhoto:
+            DrawPhoto(random, width, height, false, rgba);
+            break;
+        case CorpusPattern::kSprite:
+            DrawSprite(random, width, height, rgba);
+            break;
+        case CorpusPattern::kGreyscale:
+            DrawPhoto(random, width, height, true, rgba);
+            break;
+    }
+    return rgba;
+}
+
+Image CorpusGenerator::GenerateImage(CorpusPattern pattern, unsigned int width, unsigned int height,
+        uint64_t index) const {
+    vector<float> rgba = Generate(pattern, width, height, index);
+    Image image(width, height, vector<RGBAPixel>(width * height));
+    for (unsigned int i = 0; i < width * height; i++) {
+        RGBAPixel& pixel = image.image_data_[i];
+        pixel.red_      = (unsigned char) round(255.0f * rgba[i * 4]);
+        pixel.green_    = (unsigned char) round(255.0f * rgba[i * 4 + 1]);
+        pixel.blue_     = (unsigned char) round(255.0f * rgba[i * 4 + 2]);
+        pixel.alpha_    = round(255.0f * rgba[i * 4 + 3]);
+    }
+    return image;
+}
+
+bool CorpusGenerator::EncodePNG(vector<float> const & rgba, unsigned int width, unsigned int height,
+        CorpusEncoding encoding, vector<unsigned char>& png, ImageStatus& status) {
+    LodePNGColorType type;
+    unsigned int bits;
+    switch (encoding) {
+        case CorpusEncoding::kGrey1:        type = LCT_GREY;        bits = 1;   break;
+        case CorpusEncoding::kGrey2:        type = LCT_GREY;        bits = 2;   break;
+        case CorpusEncoding::kGrey4:        type = LCT_GREY;        bits = 4;   break;
+        case CorpusEncoding::kGrey8:        type = LCT_GREY;        bits = 8;   break;
+        case CorpusEncoding::kGrey16:       type = LCT_GREY;        bits = 16;  break;
+        case CorpusEncoding::kGreyAlpha8:   type = LCT_GREY_ALPHA;  bits = 8;   break;
+        case CorpusEncoding::kGreyAlpha16:  type = LCT_GREY_ALPHA;  bits = 16;  break;
+        case CorpusEncoding::kRGB8:         type = LCT_RGB;         bits = 8;   break;
+        case CorpusEncoding::kRGB16:        type = LCT_RGB;         bits = 16;  break;
+        case CorpusEncoding::kPalette1:     type = LCT_PALETTE;     bits = 1;   break;
+        case CorpusEncoding::kPalette2:     type = LCT_PALETTE;     bits = 2;   break;
+        case CorpusEncoding::kPalette4:     type = LCT_PALETTE;     bits = 4;   break;
+        case CorpusEncoding::kPalette8:     type = LCT_PALETTE;     bits = 8;   break;
+        case CorpusEncoding::kRGBA8:        type = LCT_RGBA;        bits = 8;   break;
+        default:                            type = LCT_RGBA;        bits = 16;  break;
+    }
+    bool grey = type == LCT_GREY || type == LCT_GREY_ALPHA;
+    bool alpha = type == LCT_GREY_ALPHA || type == LCT_RGBA || type == LCT_PALETTE;
+    unsigned int channels = (grey ? 1 : 3) + (alpha ? 1 : 0);
+
+    // reduce to the target's channels as floats first
+    size_t pixels = (size_t) width * height;
+    vector<float> samples(pixels * channels);
+    for (size_t i = 0; i < pixels; i++) {
+        const float* pixel = &rgba[i * 4];
+        float a = pixel[3], colour[3];
+        for (int c = 0; c < 3; c++)
+            colour[c] = alpha ? pixel[c] : pixel[c] * a + 1.0f - a;
+        float* out = &samples[i * channels];
+        if (grey) {
+            out[0] = 0.299f * colour[0] + 0.587f * colour[1] + 0.114f * colour[2];
+        } else {
+            copy(colour, colour + 3, out);
+        }
+        if (alpha)
+            out[channels - 1] = a;
+    }
+
+    lodepng::State state;
+    state.encoder.auto_convert = 0;
+    state.info_png.color.colortype = type;
+    state.info_png.color.bitdepth = bits;
+    state.info_raw.colortype = type;
+    state.info_raw.bitdepth = bits == 16 ? 16 : 8;
+    vector<unsigned char> raw;
+    if (type == LCT_PALETTE) {
+        // keep the most common colours at 4 bits per channel, then map each colour to its nearest entry
+        map<unsigned int, unsigned int> counts;
+        vector<unsigned int> keys(pixels);
+        for (size_t i = 0; i < pixels; i++) {
+            unsigned int key = 0;
+            for (int c = 0; c < 4; c++)
+                key = key << 4 | (unsigned int) round(15.0f * samples[i * 4 + c]);
+            keys[i] = key;
+            counts[key]++;
+        }
+        vector<pair<unsigned int, unsigned int>> ranked;
+        for (map<unsigned int, unsigned int>::const_iterator it = counts.begin(); it != counts.end(); ++it)
+            ranked.push_back(make_pair(it->second, it->first));
+        stable_sort(ranked.begin(), ranked.end(), [](pair<unsigned int, unsigned int> const & a,
+                pair<unsigned int, unsigned int> const & b) { return a.first > b.first; });
+        ranked.resize(min(ranked.size(), (size_t) 1 << bits));
+        for (unsigned int e = 0; e < ranked.size(); e++) {
+            unsigned int key = ranked[e].second;
+            unsigned char entry[4];
+            for (int c = 0; c < 4; c++)
+                entry[c] = 17 * ((key >> (12 - 4 * c)) & 15);
+            lodepng_palette_add(&state.info_png.color, entry[0], entry[1], entry[2], entry[3]);
+            lodepng_palette_add(&state.info_raw, entry[0], entry[1], entry[2], entry[3]);
+        }
+        map<unsigned int, unsigned char> nearest;
+        raw.resize(pixels);
+        for (size_t i = 0; i < pixels; i++) {
+            map<unsigned int, unsigned char>::iterator found = nearest.find(keys[i]);
+            if (found == nearest.end()) {
+                int best = 0, best_distance = 1 << 30;
+                for (unsigned int e = 0; e < ranked.size(); e++) {
+                    int distance = 0;
+                    for (int c = 0; c < 4; c++) {
+                        int d = (int) ((keys[i] >> (12 - 4 * c)) & 15) - (int) ((ranked[e].second >> (12 - 4 * c)) & 15);
+                        distance += d * d;
+                    }
+                    if (distance < best_distance) {
+                        best = e;
+                        best_distance = distance;
+                    }
+                }
+                found = nearest.insert(make_pair(keys[i], (unsigned char) best)).first;
+            }
+            raw[i] = found->second;
+        }
+    } else if (bits < 8) {
+        // exact levels spread over a byte, which lodepng narrows back to the same levels
+        unsigned int levels = (1 << bits) - 1;
+        raw.resize(pixels);
+        for (size_t i = 0; i < pixels; i++)
+            raw[i] = (unsigned char) (round(levels * samples[i]) * (255 / levels));
+    } else if (bits == 8) {
+        raw.resize(samples.size());
+        for (size_t i = 0; i < samples.size(); i++)
+            raw[i] = (unsigned char) round(255.0f * samples[i]);
+    } else {
+        raw.resize(samples.size() * 2);
+        for (size_t i = 0; i < samples.size(); i++) {
+            unsigned int value = (unsigned int) round(65535.0f * samples[i]);
+            raw[i * 2] = (unsigned char) (value >> 8);
+            raw[i * 2 + 1] = (unsigned char) value;
+        }
+    }
+
+    png.clear();
+    unsigned error = lodepng::encode(png, raw, width, height, state);
+    status = error ? ImageStatus(ImageError::kEncode, error) : ImageStatus();
+    return error == 0;
+}
+
+unsigned int CorpusGenerator::WriteCorpus(string const & directory, unsigned int count,
+        ImageStatus& status) const {
+    static const unsigned int sizes[][2] = {
+        { 1, 1000 }, { 1000, 1 }, { 32, 32 }, { 64, 48 }, { 100, 100 }, { 17, 300 },
+        { 256, 256 }, { 320, 240 }, { 512, 128 }, { 640, 480 }, { 1000, 1000 }
+    };
+    const unsigned int kSizes = sizeof(sizes) / sizeof(sizes[0]);
+    for (unsigned int i = 0; i < count; i++) {
+        CorpusPattern pattern = (CorpusPattern) (i % kPatterns);
+        CorpusEncoding encoding = (CorpusEncoding) (i / kPatterns % kEncodings);
+        unsigned int const * size = sizes[Mix(seed_ ^ i) % kSizes];
+        vector<unsigned char> png;
+        if (!EncodePNG(Generate(pattern, size[0], size[1], i), size[0], size[1], encoding, png, status))
+            return i;
+
+        char name[64];
+        snprintf(name, sizeof(name), "/%05u-%s-%ux%u-%s.png", i, PatternName(pattern).c_str(),
+                size[0], size[1], EncodingName(encoding).c_str());
+        unsigned error = lodepng::save_file(png, directory + name);
+        if (error) {
+            status = ImageStatus(ImageError::kFileWrite, error);
+            return i;
+        }
+    }
+    status = ImageStatus();
+    return count;
+}
+
+string CorpusGenerator::PatternName(CorpusPattern pattern) {
+    static const char* names[] = { "gradient", "noise", "photo", "sprite", "greyscale" };
+    return names[(int) pattern];
+}
+
+string CorpusGenerator::EncodingName(CorpusEncoding encoding) {
+    static const char* names[] = {
+        "grey1", "grey2", "grey4", "grey8", "grey16", "greyalpha8", "greyalpha16", "rgb8", "rgb16",
+        "palette1", "palette2", "palette4", "palette8", "rgba8", "rgba16"
+    };
+    return names[(int) encoding];
+}
@@ -0,0 +1,107 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Thumbhash.h"
+#ifndef _CORPUS_H_
+#define _CORPUS_H_
+
+using namespace std;
+
+/* the kinds of content the generator draws */
+enum class CorpusPattern {
+    kGradient, /* a linear blend between two colours at a random angle */
+    kNoise, /* independent uniform noise in every channel */
+    kPhoto, /* smooth content with a 1/f spectrum, like natural photos */
+    kSprite, /* soft-edged shapes on a transparent background */
+    kGreyscale /* photo-like content with no chroma */
+};
+
+/* every colour type and bit depth lodepng can write */
+enum class CorpusEncoding {
+    kGrey1, kGrey2, kGrey4, kGrey8, kGrey16,
+    kGreyAlpha8, kGreyAlpha16,
+    kRGB8, kRGB16,
+    kPalette1, kPalette2, kPalette4, kPalette8,
+    kRGBA8, kRGBA16
+};
+
+class CorpusGenerator {
+    public:
+        static const unsigned int kPatterns = 5; /* the number of CorpusPattern values */
+        static const unsigned int kEncodings = 15; /* the number of CorpusEncoding values */
+
+        /**
+         * Constructs a generator. Every image is a pure function of the seed and its index,
+         * so corpora are reproducible and any image can be regenerated on its own.
+         *
+         * @param seed - the seed for every image this generator draws
+        */
+        CorpusGenerator(uint64_t seed);
+
+        /**
+         * Draws an image as RGBA samples in [0, 1], four per pixel, row by row.
+         *
+         * @param pattern - the kind of content to draw
+         * @param width - the width of the image
+         * @param height - the height of the image
+         * @param index - selects one of the images of this pattern and size
+         * @returns the samples
+        */
+        vector<float> Generate(CorpusPattern pattern, unsigned int width, unsigned int height,
+                uint64_t index) const;
+
+        /**
+         * Draws an image like Generate and rounds it to 8 bits per channel.
+         *
+         * @param pattern - the kind of content to draw
+         * @param width - the width of the image
+         * @param height - the height of the image
+         * @param index - selects one of the images of this pattern and size
+         * @returns the image
+        */
+        Image GenerateImage(CorpusPattern pattern, unsigned int width, unsigned int height,
+                uint64_t index) const;
+
+        /**
+         * Encodes generated samples as a PNG of the given colour type and bit depth.
+         * Colour is reduced to luminance for grey encodings, alpha is composited over white
+         * for encodings without it, and palette encodings pick the most common colours.
+         *
+         * @param rgba - the samples, as returned by Generate
+         * @param width - the width of the image
+         * @param height - the height of the image
+         * @param encoding - the colour type and bit depth to write
+         * @param png - receives the PNG bytes
+         * @param status - receives why encoding failed
+         * @return true, if the image was successfully encoded.
+        */
+        static bool EncodePNG(vector<float> const & rgba, unsigned int width, unsigned int height,
+                CorpusEncoding encoding, vector<unsigned char>& png, ImageStatus& status);
+
+        /**
+         * Writes a corpus of PNGs into an existing directory. Image i is named
+         * NNNNN-pattern-WxH-encoding.png; patterns and encodings cycle so every pair appears,
+         * and sizes run from 1x1000 and 1000x1 to 1000x1000.
+         *
+         * @param directory - the directory to write into
+         * @param count - the number of images to write
+         * @param status - receives why the image after the last one written failed
+         * @returns the number of images written, which is less than count on an error
+        */
+        unsigned int WriteCorpus(string const & directory, unsigned int count, ImageStatus& status) const;
+
+        /**
+         * @returns the short name of a pattern, such as "photo"
+        */
+        static string PatternName(CorpusPattern pattern);
+
+        /**
+         * @returns the short name of an encoding, such as "rgba16"
+        */
+        static string EncodingName(CorpusEncoding encoding);
+
+    private:
+        uint64_t seed_;
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "DedupTable.h"
+#include "Digest.h"
+#include "../util/lodepng/Lodepng.h"
+#include <cstring>
+#include <fstream>
+
+using namespace std;
+
+static const char kMagic[8] = { 'T', 'H', 'D', 'E', 'D', 'U', 'P', '\0' };
+static const size_t kRecordSize = 34; // uint64 digest, uint8 hash length, 25 hash bytes
+
+const uint64_t DedupTable::kFileSeed;
+const uint64_t DedupTable::kPixelSeed;
+
+DedupStats::DedupStats() {
+    lookups_    = 0;
+    hits_       = 0;
+    entries_    = 0;
+}
+
+double DedupStats::HitRate() const {
+    return lookups_ > 0 ? (double) hits_ / lookups_ : 0.0;
+}
+
+DedupTable::DedupTable() {
+    lookups_    = 0;
+    hits_       = 0;
+}
+
+bool DedupTable::Find(uint64_t digest, vector<uint8_t>& hash) {
+    lock_guard<mutex> guard(lock_);
+    lookups_++;
+    unordered_map<uint64_t, vector<uint8_t>>::const_iterator found = hashes_.find(digest);
+    if (found == hashes_.end())
+        return false;
+    hits_++;
+    hash = found->second;
+    return true;
+}
+
+void DedupTable::Insert(uint64_t digest, vector<uint8_t> const & hash) {
+    if (hash.empty()) // a hit must always return a usable hash
+        return;
+    lock_guard<mutex> guard(lock_);
+    hashes_[digest] = hash;
+}
+
+bool DedupTable::HashFile(string const & fileName, vector<uint8_t>& hash, ImageStatus& status) {
+    vector<unsigned char> png;
+    unsigned error = lodepng::load_file(png, fileName);
+    if (error) {
+        status = ImageStatus(ImageError::kFileRead, error);
+        return false;
+    }
+    status = ImageStatus();
+    uint64_t digest = Digest64(png.empty() ? nullptr : &png[0], png.size(), kFileSeed);
+    if (Find(digest, hash))
+        return true;
+
+    Image image;
+    if (!image.ReadFromMemory(png, status))
+        return false;
+    hash = ThumbHash::RGBAToThumbHashDownscaled(image);
+    if (hash.empty()) {
+        status = ImageStatus(ImageError::kEmpty, 0);
+        return false;
+    }
+    Insert(digest, hash);
+    return true;
+}
+
+vector<uint8_t> DedupTable::HashImage(Image const & image) {
+    uint64_t digest = DigestImage(image);
+    vector<uint8_t> hash;
+    if (Find(digest, hash))
+        return hash;
+    hash = ThumbHash::RGBAToThumbHashDownscaled(image);
+    Insert(digest, hash);
+    return hash;
+}
+
+uint64_t DedupTable::DigestImage(Image const & image) {
+    // RGBAPixel stores alpha as a double, so the pixels are packed to RGBA8 before digesting
+    vector<unsigned char> byte_data(8 + image.image_data_.size() * 4);
+    for (int i = 0; i < 4; i++) {
+        byte_data[i]     = (unsigned char) (image.width_ >> (8 * i));
+        byte_data[4 + i] = (unsigned char) (image.height_ >> (8 * i));
+    }
+    for (unsigned int i = 0; i < image.image_data_.size(); i++) {
+        byte_data[8 + (i * 4)]     = image.image_data_[i].red_;
+        byte_data[8 + (i * 4) + 1] = image.image_data_[i].green_;
+        byte_data[8 + (i * 4) + 2] = image.image_data_[i].blue_;
+        byte_data[8 + (i * 4) + 3] = image.image_data_[i].alpha_;
+    }
+    return Digest64(&byte_data[0], byte_data.size(), kPixelSeed);
+}
+
+bool DedupTable::ReadFromFile(string const & fileName, FileStatus& status) {
+    vector<unsigned char> bytes;
+    if (lodepng::load_file(bytes, fileName) != 0) {
+        status = FileStatus(FileError::kRead, fileName, "");
+        return false;
+    }
+    if (bytes.size() < sizeof(kMagic) || memcmp(&bytes[0], kMagic, sizeof(kMagic)) != 0
+            || (bytes.size() - sizeof(kMagic)) % kRecordSize != 0) {
+        status = FileStatus(FileError::kFormat, fileName, "not a dedup table");
+        return false;
+    }
+    status = FileStatus();
+    lock_guard<mutex> guard(lock_);
+    for (size_t offset = sizeof(kMagic); offset < bytes.size(); offset += kRecordSize) {
+        uint64_t digest = 0;
+        for (int i = 0; i < 8; i++)
+            digest |= (uint64_t) bytes[offset + i] << (8 * i);
+        unsigned int length = min((unsigned int) bytes[offset + 8], 25u);
+        hashes_[digest] = vector<uint8_t>(bytes.begin() + offset + 9, bytes.begin() + offset + 9 + length);
+    }
+    return true;
+}
+
+bool DedupTable::WriteToFile(string const & fileName, FileStatus& status) {
+    vector<unsigned char> bytes(kMagic, kMagic + sizeof(kMagic));
+    {
+        lock_guard<mutex> guard(lock_);
+        bytes.reserve(bytes.size() + hashes_.size() * kRecordSize);
+        for (unordered_map<uint64_t, vector<uint8_t>>::const_iterator it = hashes_.begin();
+                it != hashes_.end(); ++it) {
+            unsigned char record[kRecordSize] = { 0 };
+            for (int i = 0; i < 8; i++)
+                record[i] = (unsigned char) (it->first >> (8 * i));
+            size_t length = min(it->second.size(), (size_t) 25);
+            record[8] = (unsigned char) length;
+            copy(it->second.begin(), it->second.begin() + length, record + 9);
+            bytes.insert(bytes.end(), record, record + kRecordSize);
+        }
+    }
+    if (lodepng::save_file(bytes, fileName) != 0) {
+        status = FileStatus(FileError::kWrite, fileName, "");
+        return false;
+    }
+    status = FileStatus();
+    return true;
+}
+
+DedupStats DedupTable::Stats() {
+    lock_guard<mutex> guard(lock_);
+    DedupStats stats;
+    stats.lookups_ = lookups_;
+    stats.hits_ = hits_;
+    stats.entries_ = hashes_.size();
+    return stats;
+}
@@ -0,0 +1,119 @@
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "FileStatus.h"
+#include "Thumbhash.h"
+#ifndef _DEDUPTABLE_H_
+#define _DEDUPTABLE_H_
+
+using namespace std;
+
+class DedupStats {
+    public:
+        uint64_t lookups_; /* digests looked up */
+        uint64_t hits_; /* lookups that reused an earlier ThumbHash */
+        uint64_t entries_; /* distinct digests in the table */
+
+        /**
+         * Constructs a DedupStats with every counter at 0.
+        */
+        DedupStats();
+
+        /**
+         * @returns hits / lookups, or 0 if nothing was looked up
+        */
+        double HitRate() const;
+};
+
+class DedupTable {
+    public:
+        static const uint64_t kFileSeed = 0; /* the Digest64 seed of file bytes, shared with IncrementalHasher */
+
+        /**
+         * Constructs an empty in-memory table.
+        */
+        DedupTable();
+
+        /**
+         * Looks up the ThumbHash of previously seen content.
+         * 
+         * @param digest - the Digest64 of the content
+         * @param hash - receives the ThumbHash if the digest is known
+         * @return true, if the digest is known.
+        */
+        bool Find(uint64_t digest, vector<uint8_t>& hash);
+
+        /**
+         * Records the ThumbHash of some content. Empty hashes are ignored, so a hit always
+         * returns a usable hash.
+         * 
+         * @param digest - the Digest64 of the content
+         * @param hash - the ThumbHash of the content
+        */
+        void Insert(uint64_t digest, vector<uint8_t> const & hash);
+
+        /**
+         * Hashes a PNG file, reusing the ThumbHash of identical file bytes seen before.
+         * Images larger than ThumbHash::kMaxHashEdge are downscaled before hashing.
+         * 
+         * @param fileName - name of the PNG file
+         * @param hash - receives the ThumbHash
+         * @param status - receives why the file could not be read or decoded
+         * @return true, if the file was found in the table or successfully read and hashed.
+        */
+        bool HashFile(string const & fileName, vector<uint8_t>& hash, ImageStatus& status);
+
+        /**
+         * Hashes an image, reusing the ThumbHash of identical pixels seen before.
+         * This catches duplicates that were re-encoded with different PNG settings.
+         * Images larger than ThumbHash::kMaxHashEdge are downscaled before hashing.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @returns the encoded unsigned 8-bit integer array, empty if the image has no pixels
+        */
+        vector<uint8_t> HashImage(Image const & image);
+
+        /**
+         * Computes the digest HashImage uses: the size and the RGBA bytes of every pixel.
+         * 
+         * @param image - the image to be digested
+         * @returns the digest
+        */
+        static uint64_t DigestImage(Image const & image);
+
+        /**
+         * Reads a table written by WriteToFile, adding its entries to this table.
+         * 
+         * @param fileName - name of the file to be read.
+         * @param status - receives why it failed
+         * @return true, if the table was successfully read.
+        */
+        bool ReadFromFile(string const & fileName, FileStatus& status);
+
+        /**
+         * Writes the table to a binary file of fixed-size (digest, hash) records.
+         * 
+         * @param fileName - name of the file to be written.
+         * @param status - receives why it failed
+         * @return true, if the table was successfully written.
+        */
+        bool WriteToFile(string const & fileName, FileStatus& status);
+
+        /**
+         * @returns the lookup counters
+        */
+        DedupStats Stats();
+
+    private:
+        mutex lock_;
+        unordered_map<uint64_t, vector<uint8_t>> hashes_;
+        uint64_t lookups_;
+        uint64_t hits_;
+
+        // file bytes and pixels are digested with different seeds so they never alias
+        static const uint64_t kPixelSeed = 0x7468756d62ULL;
+};
+
+#endif
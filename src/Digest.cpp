@@ -0,0 +1,85 @@
+#include "Digest.h"
+
+static const uint64_t kPrime1 = 11400714785074694791ULL;
+static const uint64_t kPrime2 = 14029467366897019727ULL;
+static const uint64_t kPrime3 = 1609587929392839161ULL;
+static const uint64_t kPrime4 = 9650029242287828579ULL;
+static const uint64_t kPrime5 = 2870177450012600261ULL;
+
+static inline uint64_t RotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// reads little-endian words regardless of alignment
+static inline uint64_t Read64(const unsigned char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++)
+        value |= (uint64_t) in[i] << (8 * i);
+    return value;
+}
+
+static inline uint32_t Read32(const unsigned char* in) {
+    return (uint32_t) in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+static inline uint64_t Round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * kPrime2;
+    accumulator = RotateLeft(accumulator, 31);
+    return accumulator * kPrime1;
+}
+
+static inline uint64_t MergeRound(uint64_t accumulator, uint64_t value) {
+    accumulator ^= Round(0, value);
+    return accumulator * kPrime1 + kPrime4;
+}
+
+uint64_t Digest64(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* in = (const unsigned char*) data;
+    const unsigned char* end = in + size;
+    uint64_t digest;
+
+    if (size >= 32) {
+        // four independent lanes keep the multiplier pipelines busy
+        uint64_t v1 = seed + kPrime1 + kPrime2;
+        uint64_t v2 = seed + kPrime2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - kPrime1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = Round(v1, Read64(in));
+            v2 = Round(v2, Read64(in + 8));
+            v3 = Round(v3, Read64(in + 16));
+            v4 = Round(v4, Read64(in + 24));
+            in += 32;
+        } while (in <= limit);
+        digest = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+        digest = MergeRound(digest, v1);
+        digest = MergeRound(digest, v2);
+        digest = MergeRound(digest, v3);
+        digest = MergeRound(digest, v4);
+    } else {
+        digest = seed + kPrime5;
+    }
+    digest += (uint64_t) size;
+
+    for (; in + 8 <= end; in += 8) {
+        digest ^= Round(0, Read64(in));
+        digest = RotateLeft(digest, 27) * kPrime1 + kPrime4;
+    }
+    if (in + 4 <= end) {
+        digest ^= (uint64_t) Read32(in) * kPrime1;
+        digest = RotateLeft(digest, 23) * kPrime2 + kPrime3;
+        in += 4;
+    }
+    for (; in < end; in++) {
+        digest ^= (*in) * kPrime5;
+        digest = RotateLeft(digest, 11) * kPrime1;
+    }
+
+    digest ^= digest >> 33;
+    digest *= kPrime2;
+    digest ^= digest >> 29;
+    digest *= kPrime3;
+    digest ^= digest >> 32;
+    return digest;
+}
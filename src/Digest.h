@@ -0,0 +1,17 @@
+#include <cstddef>
+#include <cstdint>
+#ifndef _DIGEST_H_
+#define _DIGEST_H_
+
+/**
+ * Computes a fast, non-cryptographic 64-bit digest of a buffer (the XXH64 algorithm).
+ * Suitable for change detection and deduplication, not for untrusted collision resistance.
+ * 
+ * @param data - the bytes to be digested
+ * @param size - the number of bytes
+ * @param seed - the seed, 0 unless digests need to be kept apart
+ * @returns the digest
+*/
+uint64_t Digest64(const void* data, size_t size, uint64_t seed);
+
+#endif
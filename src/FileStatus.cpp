@@ -0,0 +1,25 @@
+#include "FileStatus.h"
+
+using namespace std;
+
+FileStatus::FileStatus() {
+    error_  = FileError::kNone;
+}
+
+FileStatus::FileStatus(FileError error, string const & fileName, string const & detail) {
+    error_      = error;
+    file_name_  = fileName;
+    detail_     = detail;
+}
+
+bool FileStatus::Ok() const {
+    return error_ == FileError::kNone;
+}
+
+string FileStatus::Message() const {
+    static const char* verbs[] = { "", "cannot open ", "cannot read ", "cannot write ", "cannot map ",
+            "invalid contents in " };
+    if (Ok())
+        return "";
+    return verbs[(int) error_] + file_name_ + (detail_.empty() ? "" : ": " + detail_);
+}
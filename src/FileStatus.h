@@ -0,0 +1,49 @@
+#include <string>
+#ifndef _FILESTATUS_H_
+#define _FILESTATUS_H_
+
+using namespace std;
+
+/* why reading or writing one of the library's own files (stores, indexes, manifests) failed */
+enum class FileError {
+    kNone,
+    kOpen, /* the file could not be opened */
+    kRead, /* the file could not be read, or is too short */
+    kWrite, /* the file could not be created, written or renamed into place */
+    kMap, /* the file could not be memory-mapped */
+    kFormat /* the contents are not in the expected format */
+};
+
+class FileStatus {
+    public:
+        FileError error_; /* what failed, or kNone */
+        string file_name_; /* the file that failed */
+        string detail_; /* what was wrong with it, or an empty string */
+
+        /**
+         * Constructs a successful FileStatus.
+        */
+        FileStatus();
+
+        /**
+         * Constructs a FileStatus for a failure.
+         * 
+         * @param error - what failed
+         * @param fileName - the file that failed
+         * @param detail - what was wrong with it, such as the malformed line
+        */
+        FileStatus(FileError error, string const & fileName, string const & detail);
+
+        /**
+         * @returns true, if nothing failed
+        */
+        bool Ok() const;
+
+        /**
+         * @returns a one-line description of the failure, such as "cannot open x.ths",
+         * or an empty string if nothing failed
+        */
+        string Message() const;
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "HashIndex.h"
+#include <algorithm>
+#include <thread>
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <immintrin.h>
+#define THUMBHASH_AVX2_DISPATCH
+#endif
+
+using namespace std;
+
+// below this many hashes a search runs on the calling thread
+static const size_t kParallelThreshold = 1 << 16;
+
+const int HashIndex::kLanes;
+
+Neighbour::Neighbour(uint32_t index, float distance) {
+    index_      = index;
+    distance_   = distance;
+}
+
+static bool Closer(Neighbour const & a, Neighbour const & b) {
+    return a.distance_ < b.distance_ || (a.distance_ == b.distance_ && a.index_ < b.index_);
+}
+
+// computes the squared distance from the query to each of the kLanes hashes in a block,
+// summing even and odd coefficients apart exactly as the AVX2 version does
+static void BlockDistances(const float* block, const float* query, float* out) {
+    float even[HashIndex::kLanes] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    float odd[HashIndex::kLanes] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int d = 0; d < HashVector::kSize; d += 2) {
+        for (int j = 0; j < HashIndex::kLanes; j++) {
+            float first = block[d * HashIndex::kLanes + j] - query[d];
+            float second = block[(d + 1) * HashIndex::kLanes + j] - query[d + 1];
+            even[j] += first * first;
+            odd[j] += second * second;
+        }
+    }
+    for (int j = 0; j < HashIndex::kLanes; j++)
+        out[j] = even[j] + odd[j];
+}
+
+#ifdef THUMBHASH_AVX2_DISPATCH
+// true if AVX2 can be used: always in builds that target it, otherwise if this CPU has it
+static bool HasAVX2() {
+#ifdef __AVX2__
+    return true;
+#else
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("avx2") != 0);
+    return supported;
+#endif
+}
+
+__attribute__((target("avx2")))
+static void BlockDistancesAVX2(const float* block, const float* query, float* out) {
+    __m256 even = _mm256_setzero_ps(), odd = _mm256_setzero_ps();
+    for (int d = 0; d < HashVector::kSize; d += 2) {
+        __m256 first = _mm256_sub_ps(_mm256_loadu_ps(block + d * 8), _mm256_set1_ps(query[d]));
+        __m256 second = _mm256_sub_ps(_mm256_loadu_ps(block + (d + 1) * 8), _mm256_set1_ps(query[d + 1]));
+        even = _mm256_add_ps(even, _mm256_mul_ps(first, first));
+        odd = _mm256_add_ps(odd, _mm256_mul_ps(second, second));
+    }
+    _mm256_storeu_ps(out, _mm256_add_ps(even, odd));
+}
+#endif
+
+HashIndex::HashIndex(unsigned int threads) {
+    threads_ = threads > 0 ? threads : max(1u, thread::hardware_concurrency());
+    count_ = 0;
+
+    // the calling thread searches a slice of every query, so the pool holds one thread fewer
+    stopping_ = false;
+    for (unsigned int i = 1; i < threads_; i++)
+        pool_.push_back(thread(&HashIndex::WorkerLoop, this));
+}
+
+HashIndex::~HashIndex() {
+    {
+        lock_guard<mutex> guard(lock_);
+        stopping_ = true;
+    }
+    ready_.notify_all();
+    for (unsigned int i = 0; i < pool_.size(); i++)
+        pool_[i].join();
+}
+
+void HashIndex::WorkerLoop() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock<mutex> guard(lock_);
+            ready_.wait(guard, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty())
+                return;
+            task = tasks_.front();
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+bool HashIndex::Add(vector<uint8_t> const & hash) {
+    HashVector unpacked;
+    if (!unpacked.Unpack(hash))
+        return false;
+    Add(unpacked);
+    return true;
+}
+
+void HashIndex::Add(HashVector const & vector) {
+    size_t block = count_ / kLanes, lane = count_ % kLanes;
+    if (lane == 0)
+        blocks_.resize(blocks_.size() + HashVector::kSize * kLanes, 0.0f);
+    float* out = &blocks_[block * HashVector::kSize * kLanes + lane];
+    for (int d = 0; d < HashVector::kSize; d++)
+        out[d * kLanes] = vector.values_[d];
+    count_++;
+}
+
+void HashIndex::Reserve(size_t count) {
+    blocks_.reserve((count + kLanes - 1) / kLanes * HashVector::kSize * kLanes);
+}
+
+size_t HashIndex::Size() const {
+    return count_;
+}
+
+vector<Neighbour> HashIndex::Search(vector<uint8_t> const & query, size_t k) const {
+    HashVector unpacked;
+    if (!unpacked.Unpack(query))
+        return vector<Neighbour>();
+    return Search(unpacked, k);
+}
+
+vector<Neighbour> HashIndex::Search(HashVector const & query, size_t k) const {
+    size_t blocks = (count_ + kLanes - 1) / kLanes;
+    size_t workers = count_ >= kParallelThreshold ? min((size_t) threads_, blocks) : 1;
+    vector<vector<Neighbour>> partial(max((size_t) 1, workers));
+    if (k > 0 && workers <= 1) {
+        SearchBlocks(query, k, 0, blocks, partial[0]);
+    } else if (k > 0) {
+        // the pool searches every slice but the first, which the calling thread searches meanwhile
+        size_t chunk = (blocks + workers - 1) / workers;
+        mutex done_lock;
+        condition_variable done;
+        size_t pending = (blocks - 1) / chunk;
+        {
+            lock_guard<mutex> guard(lock_);
+            for (size_t begin = chunk, w = 1; begin < blocks; begin += chunk, w++) {
+                size_t end = min(blocks, begin + chunk);
+                vector<Neighbour>* out = &partial[w];
+                tasks_.push_back([this, &query, k, begin, end, out, &done_lock, &done, &pending] {
+                    SearchBlocks(query, k, begin, end, *out);
+                    lock_guard<mutex> finished(done_lock);
+                    if (--pending == 0)
+                        done.notify_one();
+                });
+            }
+        }
+        ready_.notify_all();
+        SearchBlocks(query, k, 0, min(blocks, chunk), partial[0]);
+        unique_lock<mutex> guard(done_lock);
+        done.wait(guard, [&pending] { return pending == 0; });
+    }
+
+    vector<Neighbour> best;
+    for (unsigned int w = 0; w < partial.size(); w++)
+        best.insert(best.end(), partial[w].begin(), partial[w].end());
+    sort(best.begin(), best.end(), Closer);
+    if (best.size() > k)
+        best.erase(best.begin() + k, best.end());
+    return best;
+}
+
+void HashIndex::SearchBlocks(HashVector const & query, size_t k, size_t begin, size_t end,
+        vector<Neighbour>& best) const {
+    // best is a max-heap on distance, so its front is the neighbour to beat
+    best.clear();
+    best.reserve(k + 1);
+    void (*block_distances)(const float*, const float*, float*) = BlockDistances;
+#ifdef THUMBHASH_AVX2_DISPATCH
+    if (HasAVX2())
+        block_distances = BlockDistancesAVX2;
+#endif
+    float distances[kLanes];
+    for (size_t block = begin; block < end; block++) {
+        block_distances(&blocks_[block * HashVector::kSize * kLanes], query.values_, distances);
+        size_t lanes = min((size_t) kLanes, count_ - block * kLanes);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            if (best.size() == k && distances[lane] >= best.front().distance_)
+                continue;
+            best.push_back(Neighbour(block * kLanes + lane, distances[lane]));
+            push_heap(best.begin(), best.end(), Closer);
+            if (best.size() > k) {
+                pop_heap(best.begin(), best.end(), Closer);
+                best.pop_back();
+            }
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Similarity.h"
+#ifndef _HASHINDEX_H_
+#define _HASHINDEX_H_
+
+using namespace std;
+
+class Neighbour {
+    public:
+        uint32_t index_; /* the position of the hash in insertion order */
+        float distance_; /* the squared coefficient distance to the query */
+
+        /**
+         * Constructs a Neighbour.
+         * 
+         * @param index - the position of the hash in insertion order
+         * @param distance - the squared coefficient distance to the query
+        */
+        Neighbour(uint32_t index, float distance);
+};
+
+class HashIndex {
+    public:
+        static const int kLanes = 8; /* hashes per block, one AVX2 register of floats */
+
+        /**
+         * Constructs an empty index. The worker threads are started here and kept until
+         * destruction, so large searches never create threads; the calling thread searches
+         * one slice of the index itself.
+         * 
+         * @param threads - the number of threads used by large searches, the caller included,
+         *                  or 0 to use all cores
+        */
+        HashIndex(unsigned int threads);
+
+        /**
+         * Stops the worker threads.
+        */
+        ~HashIndex();
+
+        /**
+         * Unpacks a hash and appends it to the index.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @return true, if the hash was valid and has been added.
+        */
+        bool Add(vector<uint8_t> const & hash);
+
+        /**
+         * Appends an already unpacked hash to the index.
+         * 
+         * @param vector - the unpacked coefficients
+        */
+        void Add(HashVector const & vector);
+
+        /**
+         * Reserves room for a number of hashes, to avoid regrowing while building.
+         * 
+         * @param count - the number of hashes
+        */
+        void Reserve(size_t count);
+
+        /**
+         * @returns the number of hashes in the index
+        */
+        size_t Size() const;
+
+        /**
+         * Finds the k hashes closest to a query by brute force over every hash.
+         * Distances use AVX2 when the CPU has it, checked at runtime unless the build
+         * targets it; the portable path sums in the same order, so both give the same result.
+         * 
+         * @param query - the unsigned 8-bit integer array
+         * @param k - the number of neighbours to return
+         * @returns up to k neighbours, closest first, or none if the query is invalid
+        */
+        vector<Neighbour> Search(vector<uint8_t> const & query, size_t k) const;
+
+        /**
+         * Finds the k hashes closest to an unpacked query by brute force over every hash.
+         * 
+         * @param query - the unpacked coefficients
+         * @param k - the number of neighbours to return
+         * @returns up to k neighbours, closest first
+        */
+        vector<Neighbour> Search(HashVector const & query, size_t k) const;
+
+    private:
+        unsigned int threads_;
+        size_t count_;
+        vector<thread> pool_; /* threads_ - 1 workers, shared by concurrent Search calls */
+        mutable mutex lock_;
+        mutable condition_variable ready_;
+        mutable deque<function<void()>> tasks_; /* slices waiting for a worker */
+        bool stopping_;
+
+        /*
+         * Blocked structure of arrays: block b holds kLanes hashes, and coefficient d of lane j
+         * is at blocks_[(b * HashVector::kSize + d) * kLanes + j], so one block is a contiguous
+         * 1.75 KiB tile and each coefficient of a block is one vector load.
+        */
+        vector<float> blocks_;
+
+        void WorkerLoop();
+
+        void SearchBlocks(HashVector const & query, size_t k, size_t begin, size_t end,
+                vector<Neighbour>& best) const;
+
+        HashIndex(HashIndex const &);
+        HashIndex& operator=(HashIndex const &);
+};
+
+#endif
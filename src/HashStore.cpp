@@ -0,0 +1,182 @@
+#include "HashStore.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const char kMagic[8] = { 'T', 'H', 'S', 'T', 'O', 'R', 'E', '\0' };
+static const size_t kHeaderSize = 24;
+static const size_t kRecordSize = 40;
+
+const uint32_t HashStore::kVersion;
+const size_t HashStore::kMaxHashSize;
+
+static void PutLittleEndian(unsigned char* out, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; i++)
+        out[i] = (unsigned char) (value >> (8 * i));
+}
+
+static uint64_t GetLittleEndian(const unsigned char* in, int bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; i++)
+        value |= (uint64_t) in[i] << (8 * i);
+    return value;
+}
+
+bool HashStoreWriter::Add(string const & key, vector<uint8_t> const & hash) {
+    if (hash.size() > HashStore::kMaxHashSize)
+        return false;
+    records_.push_back(make_pair(key, hash));
+    return true;
+}
+
+bool HashStoreWriter::WriteToFile(string const & fileName, FileStatus& status) {
+    // a stable sort keeps insertion order among equal keys, so the last one added wins
+    stable_sort(records_.begin(), records_.end(),
+            [](pair<string, vector<uint8_t>> const & a, pair<string, vector<uint8_t>> const & b) {
+                return a.first < b.first;
+            });
+    vector<pair<string, vector<uint8_t>>> unique;
+    for (unsigned int i = 0; i < records_.size(); i++) {
+        if (!unique.empty() && unique.back().first == records_[i].first)
+            unique.back() = records_[i];
+        else
+            unique.push_back(records_[i]);
+    }
+    records_.swap(unique);
+
+    size_t keys_offset = kHeaderSize + records_.size() * kRecordSize;
+    vector<unsigned char> header_and_records(keys_offset, 0);
+    memcpy(&header_and_records[0], kMagic, sizeof(kMagic));
+    PutLittleEndian(&header_and_records[8], HashStore::kVersion, 4);
+    PutLittleEndian(&header_and_records[12], records_.size(), 4);
+    PutLittleEndian(&header_and_records[16], keys_offset, 8);
+    uint64_t key_offset = 0;
+    for (unsigned int i = 0; i < records_.size(); i++) {
+        unsigned char* record = &header_and_records[kHeaderSize + i * kRecordSize];
+        PutLittleEndian(record, key_offset, 8);
+        PutLittleEndian(record + 8, records_[i].first.size(), 4);
+        record[12] = (unsigned char) records_[i].second.size();
+        copy(records_[i].second.begin(), records_[i].second.end(), record + 13);
+        key_offset += records_[i].first.size();
+    }
+
+    ofstream out(fileName.c_str(), ios::binary | ios::trunc);
+    out.write((const char*) &header_and_records[0], header_and_records.size());
+    for (unsigned int i = 0; i < records_.size(); i++)
+        out.write(records_[i].first.data(), records_[i].first.size());
+    out.close();
+    if (!out) {
+        status = FileStatus(FileError::kWrite, fileName, "");
+        return false;
+    }
+    status = FileStatus();
+    return true;
+}
+
+HashStore::HashStore() {
+    data_       = nullptr;
+    size_       = 0;
+    count_      = 0;
+    records_    = nullptr;
+    keys_       = nullptr;
+}
+
+HashStore::~HashStore() {
+    Close();
+}
+
+bool HashStore::Open(string const & fileName, FileStatus& status) {
+    Close();
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+        status = FileStatus(FileError::kOpen, fileName, strerror(errno));
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < kHeaderSize) {
+        status = FileStatus(FileError::kRead, fileName, "too short for a hash store");
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        status = FileStatus(FileError::kMap, fileName, strerror(errno));
+        return false;
+    }
+    data_ = (const unsigned char*) mapped;
+    size_ = info.st_size;
+
+    uint64_t count = GetLittleEndian(data_ + 12, 4);
+    uint64_t keys_offset = GetLittleEndian(data_ + 16, 8);
+    if (memcmp(data_, kMagic, sizeof(kMagic)) != 0 || GetLittleEndian(data_ + 8, 4) != kVersion
+            || keys_offset != kHeaderSize + count * kRecordSize || keys_offset > size_) {
+        status = FileStatus(FileError::kFormat, fileName, "not a hash store header");
+        Close();
+        return false;
+    }
+    count_ = count;
+    records_ = data_ + kHeaderSize;
+    keys_ = data_ + keys_offset;
+    status = FileStatus();
+    return true;
+}
+
+void HashStore::Close() {
+    if (data_)
+        munmap((void*) data_, size_);
+    data_       = nullptr;
+    size_       = 0;
+    count_      = 0;
+    records_    = nullptr;
+    keys_       = nullptr;
+}
+
+bool HashStore::Find(string const & key, vector<uint8_t>& hash) const {
+    size_t keys_size = size_ - (keys_ - data_);
+    size_t low = 0, high = count_;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const unsigned char* record = records_ + middle * kRecordSize;
+        uint64_t offset = GetLittleEndian(record, 8);
+        uint64_t length = GetLittleEndian(record + 8, 4);
+        if (offset + length > keys_size) // a truncated file never matches
+            return false;
+        int order = memcmp(keys_ + offset, key.data(), min((size_t) length, key.size()));
+        if (order == 0)
+            order = length < key.size() ? -1 : length > key.size() ? 1 : 0;
+        if (order == 0) {
+            unsigned int hash_length = min((size_t) record[12], kMaxHashSize);
+            hash.assign(record + 13, record + 13 + hash_length);
+            return true;
+        }
+        if (order < 0)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return false;
+}
+
+size_t HashStore::Size() const {
+    return count_;
+}
+
+void HashStore::At(size_t index, string& key, vector<uint8_t>& hash) const {
+    const unsigned char* record = records_ + index * kRecordSize;
+    uint64_t offset = GetLittleEndian(record, 8);
+    uint64_t length = GetLittleEndian(record + 8, 4);
+    size_t keys_size = size_ - (keys_ - data_);
+    if (offset + length > keys_size)
+        length = offset < keys_size ? keys_size - offset : 0;
+    key.assign((const char*) keys_ + min((size_t) offset, keys_size), length);
+    unsigned int hash_length = min((size_t) record[12], kMaxHashSize);
+    hash.assign(record + 13, record + 13 + hash_length);
+}
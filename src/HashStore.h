@@ -0,0 +1,109 @@
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "FileStatus.h"
+#ifndef _HASHSTORE_H_
+#define _HASHSTORE_H_
+
+using namespace std;
+
+/*
+ * On-disk layout, all integers little-endian:
+ * 
+ *   header    magic "THSTORE\0", uint32 version, uint32 count, uint64 keys offset
+ *   records   count fixed-size records sorted by key bytes:
+ *             uint64 key offset (into the keys blob), uint32 key length,
+ *             uint8 hash length, 25 hash bytes, 3 bytes of padding
+ *   keys      the concatenated key bytes
+*/
+
+class HashStoreWriter {
+    public:
+        /**
+         * Adds a record. Adding the same key again replaces its hash.
+         * 
+         * @param key - the key, usually the path of the hashed file
+         * @param hash - the ThumbHash, at most 25 bytes
+         * @return true, if the hash fits in a record slot.
+        */
+        bool Add(string const & key, vector<uint8_t> const & hash);
+
+        /**
+         * Sorts the records and writes the store to a file.
+         * 
+         * @param fileName - name of the file to be written.
+         * @param status - receives why it failed
+         * @return true, if the store was successfully written.
+        */
+        bool WriteToFile(string const & fileName, FileStatus& status);
+
+    private:
+        vector<pair<string, vector<uint8_t>>> records_;
+};
+
+class HashStore {
+    public:
+        static const uint32_t kVersion = 1;
+        static const size_t kMaxHashSize = 25;
+
+        /**
+         * Constructs a closed store.
+        */
+        HashStore();
+
+        /**
+         * Unmaps the store, if it is open.
+        */
+        ~HashStore();
+
+        /**
+         * Memory-maps a store written by HashStoreWriter.
+         * Closes any store that was already open.
+         * 
+         * @param fileName - name of the file to be opened.
+         * @param status - receives why it failed
+         * @return true, if the file was mapped and its header is valid.
+        */
+        bool Open(string const & fileName, FileStatus& status);
+
+        /**
+         * Unmaps the store.
+        */
+        void Close();
+
+        /**
+         * Looks a key up with a binary search over the mapped records, without copying keys.
+         * 
+         * @param key - the key to look up
+         * @param hash - receives the ThumbHash if the key is found
+         * @return true, if the key is in the store.
+        */
+        bool Find(string const & key, vector<uint8_t>& hash) const;
+
+        /**
+         * @returns the number of records in the store
+        */
+        size_t Size() const;
+
+        /**
+         * Reads the record at a position in key order.
+         * 
+         * @param index - the record index, less than Size()
+         * @param key - receives the key
+         * @param hash - receives the ThumbHash
+        */
+        void At(size_t index, string& key, vector<uint8_t>& hash) const;
+
+    private:
+        const unsigned char* data_;
+        size_t size_;
+        size_t count_;
+        const unsigned char* records_;
+        const unsigned char* keys_;
+
+        HashStore(HashStore const &);
+        HashStore& operator=(HashStore const &);
+};
+
+#endif
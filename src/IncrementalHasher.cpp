@@ -0,0 +1,219 @@
+#include "IncrementalHasher.h"
+#include "DedupTable.h"
+#include "Digest.h"
+#include "Thumbhash.h"
+#include "../util/lodepng/Lodepng.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+
+using namespace std;
+
+ManifestEntry::ManifestEntry() {
+    size_   = 0;
+    mtime_  = 0;
+    digest_ = 0;
+}
+
+IncrementalStats::IncrementalStats() {
+    scanned_    = 0;
+    unchanged_  = 0;
+    touched_    = 0;
+    rehashed_   = 0;
+    removed_    = 0;
+    failed_     = 0;
+}
+
+static int64_t ModificationTime(struct stat const & info) {
+#ifdef __APPLE__
+    return (int64_t) info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    return (int64_t) info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+}
+
+static bool IsPNG(string const & name) {
+    if (name.size() < 4)
+        return false;
+    string extension = name.substr(name.size() - 4);
+    for (unsigned int i = 0; i < extension.size(); i++)
+        extension[i] = tolower(extension[i]);
+    return extension == ".png";
+}
+
+IncrementalHasher::IncrementalHasher() {
+    dedup_ = nullptr;
+}
+
+void IncrementalHasher::UseDedupTable(DedupTable* table) {
+    dedup_ = table;
+}
+
+bool IncrementalHasher::ReadManifest(string const & fileName, FileStatus& status) {
+    entries_.clear();
+    status = FileStatus();
+    ifstream in(fileName.c_str());
+    if (!in)
+        return true;
+
+    string line;
+    while (getline(in, line)) {
+        istringstream fields(line);
+        string path, size, mtime, digest, hash;
+        if (!getline(fields, path, '\t') || !getline(fields, size, '\t') || !getline(fields, mtime, '\t')
+                || !getline(fields, digest, '\t')) {
+            status = FileStatus(FileError::kFormat, fileName, "malformed line: " + line);
+            return false;
+        }
+        getline(fields, hash, '\t');
+        ManifestEntry& entry = entries_[path];
+        entry.size_ = strtoull(size.c_str(), nullptr, 10);
+        entry.mtime_ = strtoll(mtime.c_str(), nullptr, 10);
+        entry.digest_ = strtoull(digest.c_str(), nullptr, 16);
+        for (unsigned int i = 0; i + 1 < hash.size(); i += 2)
+            entry.hash_.push_back((uint8_t) strtoul(hash.substr(i, 2).c_str(), nullptr, 16));
+    }
+    return true;
+}
+
+bool IncrementalHasher::WriteManifest(string const & fileName, FileStatus& status) {
+    ofstream out(fileName.c_str(), ios::trunc);
+    char digest[17], byte[3];
+    for (map<string, ManifestEntry>::const_iterator it = entries_.begin(); it != entries_.end(); ++it) {
+        snprintf(digest, sizeof(digest), "%016llx", (unsigned long long) it->second.digest_);
+        out << it->first << '\t' << it->second.size_ << '\t' << it->second.mtime_ << '\t' << digest << '\t';
+        for (unsigned int i = 0; i < it->second.hash_.size(); i++) {
+            snprintf(byte, sizeof(byte), "%02x", it->second.hash_[i]);
+            out << byte;
+        }
+        out << '\n';
+    }
+    out.close();
+    if (!out) {
+        status = FileStatus(FileError::kWrite, fileName, "");
+        return false;
+    }
+    status = FileStatus();
+    return true;
+}
+
+IncrementalStats IncrementalHasher::Update(string const & root) {
+    IncrementalStats stats;
+    map<string, bool> seen;
+    Walk(root, seen, stats);
+
+    // drop entries under this root whose files are gone
+    string prefix = root + "/";
+    map<string, ManifestEntry>::iterator it = entries_.lower_bound(prefix);
+    while (it != entries_.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        if (seen.count(it->first)) {
+            ++it;
+        } else {
+            entries_.erase(it++);
+            stats.removed_++;
+        }
+    }
+    return stats;
+}
+
+map<string, ManifestEntry> const & IncrementalHasher::Entries() const {
+    return entries_;
+}
+
+void IncrementalHasher::Walk(string const & directory, map<string, bool>& seen, IncrementalStats& stats) {
+    DIR* listing = opendir(directory.c_str());
+    if (!listing) {
+        stats.failures_[directory] = string("cannot open directory: ") + strerror(errno);
+        return;
+    }
+    vector<string> names;
+    while (dirent* item = readdir(listing)) {
+        string name = item->d_name;
+        if (name != "." && name != "..")
+            names.push_back(name);
+    }
+    closedir(listing);
+
+    for (unsigned int i = 0; i < names.size(); i++) {
+        string path = directory + "/" + names[i];
+        struct stat info;
+        if (lstat(path.c_str(), &info) != 0)
+            continue;
+        // symlinks to files are hashed, but symlinked directories are not followed, so a link
+        // to an ancestor cannot recurse forever
+        if (S_ISLNK(info.st_mode) && (stat(path.c_str(), &info) != 0 || S_ISDIR(info.st_mode)))
+            continue;
+        if (S_ISDIR(info.st_mode)) {
+            Walk(path, seen, stats);
+        } else if (S_ISREG(info.st_mode) && IsPNG(names[i])) {
+            stats.scanned_++;
+            // the manifest is tab and line separated, so such paths cannot be recorded
+            if (path.find_first_of("\t\n\r") != string::npos) {
+                stats.failed_++;
+                stats.failures_[path] = "the manifest cannot record paths with tabs or line breaks";
+                continue;
+            }
+            seen[path] = true;
+            Visit(path, info.st_size, ModificationTime(info), stats);
+        }
+    }
+}
+
+void IncrementalHasher::Visit(string const & path, uint64_t size, int64_t mtime, IncrementalStats& stats) {
+    map<string, ManifestEntry>::iterator found = entries_.find(path);
+    // entries without a hash, from manifests that recorded failures, are always retried
+    bool known = found != entries_.end() && !found->second.hash_.empty();
+    if (known && found->second.size_ == size && found->second.mtime_ == mtime) {
+        stats.unchanged_++;
+        return;
+    }
+
+    vector<unsigned char> png;
+    unsigned error = lodepng::load_file(png, path);
+    if (error) {
+        stats.failed_++;
+        stats.failures_[path] = ImageStatus(ImageError::kFileRead, error).Message();
+        return;
+    }
+    uint64_t digest = Digest64(png.empty() ? nullptr : &png[0], png.size(), DedupTable::kFileSeed);
+    ManifestEntry& entry = entries_[path];
+    if (known && entry.size_ == size && entry.digest_ == digest) {
+        entry.mtime_ = mtime;
+        stats.touched_++;
+        return;
+    }
+
+    Image image;
+    ImageStatus status;
+    entry.size_ = size;
+    entry.mtime_ = mtime;
+    entry.digest_ = digest;
+    entry.hash_.clear();
+    if (dedup_ && dedup_->Find(digest, entry.hash_)) {
+        stats.rehashed_++;
+        return;
+    }
+    if (!image.ReadFromMemory(png, status)) {
+        // record nothing, so the next scan retries the file and reports it again
+        entries_.erase(path);
+        stats.failed_++;
+        stats.failures_[path] = status.Message();
+        return;
+    }
+    // most photos are larger than the encoder accepts, so hash a downscaled copy
+    entry.hash_ = ThumbHash::RGBAToThumbHashDownscaled(image);
+    if (entry.hash_.empty()) {
+        entries_.erase(path);
+        stats.failed_++;
+        stats.failures_[path] = "the image is empty";
+        return;
+    }
+    if (dedup_)
+        dedup_->Insert(digest, entry.hash_);
+    stats.rehashed_++;
+}
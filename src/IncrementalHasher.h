@@ -0,0 +1,103 @@
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "FileStatus.h"
+#ifndef _INCREMENTALHASHER_H_
+#define _INCREMENTALHASHER_H_
+
+using namespace std;
+
+class DedupTable;
+
+class ManifestEntry {
+    public:
+        uint64_t size_; /* the file size in bytes */
+        int64_t mtime_; /* the modification time in nanoseconds since the epoch */
+        uint64_t digest_; /* Digest64 of the file bytes */
+        vector<uint8_t> hash_; /* the ThumbHash, empty if the image could not be hashed */
+
+        /**
+         * Constructs an empty ManifestEntry.
+        */
+        ManifestEntry();
+};
+
+class IncrementalStats {
+    public:
+        uint64_t scanned_; /* PNG files found in the tree */
+        uint64_t unchanged_; /* skipped because size and mtime matched */
+        uint64_t touched_; /* mtime moved but the content digest matched */
+        uint64_t rehashed_; /* content changed, or the file is new */
+        uint64_t removed_; /* manifest entries whose file is gone */
+        uint64_t failed_; /* files that could not be read or decoded */
+        map<string, string> failures_; /* why each failed file, or unreadable directory, failed, by path */
+
+        /**
+         * Constructs an IncrementalStats with every counter at 0.
+        */
+        IncrementalStats();
+};
+
+class IncrementalHasher {
+    public:
+        /**
+         * Constructs a hasher with an empty manifest and no dedup table.
+        */
+        IncrementalHasher();
+
+        /**
+         * Shares a dedup table with the hasher. Changed files whose bytes match content
+         * hashed before reuse that ThumbHash instead of being decoded again.
+         * 
+         * @param table - the table to consult and fill, or nullptr to hash every change
+        */
+        void UseDedupTable(DedupTable* table);
+
+        /**
+         * Reads a manifest written by WriteManifest. Overwrites any current entries.
+         * A missing file is not an error; it simply yields an empty manifest.
+         * 
+         * @param fileName - name of the manifest to be read.
+         * @param status - receives why it failed
+         * @return true, if the manifest was missing or successfully read.
+        */
+        bool ReadManifest(string const & fileName, FileStatus& status);
+
+        /**
+         * Writes the manifest as one tab-separated line per file:
+         * path, size, mtime, digest and the hex ThumbHash.
+         * 
+         * @param fileName - name of the manifest to be written.
+         * @param status - receives why it failed
+         * @return true, if the manifest was successfully written.
+        */
+        bool WriteManifest(string const & fileName, FileStatus& status);
+
+        /**
+         * Walks a directory tree and brings the manifest up to date with its PNG files.
+         * Files whose size and mtime match are skipped without being opened. When only the
+         * mtime moved, the file is read and its digest compared before deciding to rehash.
+         * Files that cannot be decoded are left out of the manifest, so every scan retries
+         * and counts them; so are paths containing a tab or line break, which the manifest
+         * format cannot hold.
+         * 
+         * @param root - the directory to be scanned
+         * @returns the counters for this scan
+        */
+        IncrementalStats Update(string const & root);
+
+        /**
+         * @returns the manifest entries, keyed by path
+        */
+        map<string, ManifestEntry> const & Entries() const;
+
+    private:
+        map<string, ManifestEntry> entries_;
+        DedupTable* dedup_;
+
+        void Walk(string const & directory, map<string, bool>& seen, IncrementalStats& stats);
+        void Visit(string const & path, uint64_t size, int64_t mtime, IncrementalStats& stats);
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "PlaceholderCache.h"
+#include "Base64.h"
+#include "Thumbhash.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+using namespace std;
+
+const int PlaceholderCache::kLinearLight;
+
+// rough per-entry bookkeeping cost of the list node, the map node and the shared buffer
+static const size_t kEntryOverhead = 128;
+
+CacheStats::CacheStats() {
+    hits_       = 0;
+    misses_     = 0;
+    evictions_  = 0;
+    entries_    = 0;
+    bytes_      = 0;
+}
+
+PlaceholderCache::PlaceholderCache(size_t capacity, unsigned int shards)
+        : hits_(0), misses_(0), evictions_(0) {
+    shards = max(1u, shards);
+    shard_capacity_ = capacity / shards;
+    for (unsigned int i = 0; i < shards; i++) {
+        shards_.push_back(unique_ptr<Shard>(new Shard()));
+        shards_.back()->bytes = 0;
+    }
+}
+
+shared_ptr<const vector<unsigned char>> PlaceholderCache::GetRGBA(vector<uint8_t> const & hash,
+        unsigned int width, unsigned int height) {
+    return Get(kRGBA, hash, width, height, false);
+}
+
+shared_ptr<const vector<unsigned char>> PlaceholderCache::GetRGBA(vector<uint8_t> const & hash,
+        unsigned int width, unsigned int height, bool linear_light) {
+    return Get(kRGBA, hash, width, height, linear_light);
+}
+
+shared_ptr<const vector<unsigned char>> PlaceholderCache::GetPNG(vector<uint8_t> const & hash,
+        unsigned int width, unsigned int height) {
+    return Get(kPNG, hash, width, height, false);
+}
+
+shared_ptr<const vector<unsigned char>> PlaceholderCache::GetPNG(vector<uint8_t> const & hash,
+        unsigned int width, unsigned int height, bool linear_light) {
+    return Get(kPNG, hash, width, height, linear_light);
+}
+
+string PlaceholderCache::GetDataURI(vector<uint8_t> const & hash, unsigned int width,
+        unsigned int height) {
+    return GetDataURI(hash, width, height, false);
+}
+
+string PlaceholderCache::GetDataURI(vector<uint8_t> const & hash, unsigned int width,
+        unsigned int height, bool linear_light) {
+    shared_ptr<const vector<unsigned char>> uri = Get(kDataURI, hash, width, height, linear_light);
+    return string(uri->begin(), uri->end());
+}
+
+CacheStats PlaceholderCache::Stats() const {
+    CacheStats stats;
+    stats.hits_ = hits_.load();
+    stats.misses_ = misses_.load();
+    stats.evictions_ = evictions_.load();
+    for (unsigned int i = 0; i < shards_.size(); i++) {
+        lock_guard<mutex> guard(shards_[i]->lock);
+        stats.entries_ += shards_[i]->index.size();
+        stats.bytes_ += shards_[i]->bytes;
+    }
+    return stats;
+}
+
+void PlaceholderCache::Clear() {
+    for (unsigned int i = 0; i < shards_.size(); i++) {
+        lock_guard<mutex> guard(shards_[i]->lock);
+        shards_[i]->entries.clear();
+        shards_[i]->index.clear();
+        shards_[i]->bytes = 0;
+    }
+}
+
+shared_ptr<const vector<unsigned char>> PlaceholderCache::Get(Kind kind,
+        vector<uint8_t> const & hash, unsigned int width, unsigned int height, bool linear_light) {
+    // the decoders do not bounds-check, so malformed hashes are turned away before the key is built
+    if (hash.size() > (size_t) ThumbHash::kMaxHashSize
+            || !ThumbHash::IsValidThumbHash(hash.data(), hash.size()))
+        return make_shared<const vector<unsigned char>>();
+
+    // resolve the default size first, so it shares an entry with a request for the same size
+    if (width == 0 || height == 0) {
+        float ratio = ThumbHash::ThumbHashToApproximateAspectRatio(hash);
+        width = round(ratio > 1.0f ? 32.0f : 32.0f * ratio);
+        height = round(ratio > 1.0f ? 32.0f / ratio : 32.0f);
+    }
+
+    // key layout: kind and the linear-light bit, width and height as 4 bytes each, then the raw hash bytes
+    string key(9 + hash.size(), '\0');
+    key[0] = (char) (kind | (linear_light ? kLinearLight : 0));
+    for (int i = 0; i < 4; i++) {
+        key[1 + i] = (char) (width >> (8 * i));
+        key[5 + i] = (char) (height >> (8 * i));
+    }
+    copy(hash.begin(), hash.end(), key.begin() + 9);
+    Shard& shard = *shards_[std::hash<string>()(key) % shards_.size()];
+
+    {
+        lock_guard<mutex> guard(shard.lock);
+        unordered_map<string, list<Entry>::iterator>::iterator found = shard.index.find(key);
+        if (found != shard.index.end()) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, found->second);
+            hits_++;
+            return found->second->value;
+        }
+    }
+
+    // render without holding the lock, so a slow decode never blocks hits on the same shard
+    misses_++;
+    shared_ptr<const vector<unsigned char>> value = Render(kind, hash, width, height, linear_light);
+    size_t cost = key.size() + value->size() + kEntryOverhead;
+    if (cost > shard_capacity_)
+        return value;
+
+    lock_guard<mutex> guard(shard.lock);
+    unordered_map<string, list<Entry>::iterator>::iterator found = shard.index.find(key);
+    if (found != shard.index.end()) // another thread rendered it first
+        return found->second->value;
+    while (shard.bytes + cost > shard_capacity_ && !shard.entries.empty()) {
+        Entry& oldest = shard.entries.back();
+        shard.bytes -= oldest.key.size() + oldest.value->size() + kEntryOverhead;
+        shard.index.erase(oldest.key);
+        shard.entries.pop_back();
+        evictions_++;
+    }
+    Entry entry;
+    entry.key = key;
+    entry.value = value;
+    shard.entries.push_front(entry);
+    shard.index[key] = shard.entries.begin();
+    shard.bytes += cost;
+    return value;
+}
+
+shared_ptr<const vector<unsigned char>> PlaceholderCache::Render(Kind kind,
+        vector<uint8_t> const & hash, unsigned int width, unsigned int height, bool linear_light) {
+    if (kind == kDataURI) {
+        // rendered directly, so a data URI miss neither counts nor caches a PNG lookup
+        shared_ptr<const vector<unsigned char>> png = Render(kPNG, hash, width, height, linear_light);
+        if (png->empty())
+            return png;
+        string uri = "data:image/png;base64," + Base64Encode(*png);
+        return make_shared<const vector<unsigned char>>(uri.begin(), uri.end());
+    }
+
+    Image image = ThumbHash::ThumbHashToRGBA(hash, width, height, linear_light);
+    shared_ptr<vector<unsigned char>> bytes = make_shared<vector<unsigned char>>();
+    if (kind == kPNG) {
+        ImageStatus status;
+        if (!image.WriteToMemory(*bytes, status))
+            bytes->clear();
+    } else {
+        bytes->resize(image.image_data_.size() * 4);
+        for (unsigned int i = 0; i < image.image_data_.size(); i++) {
+            (*bytes)[(i * 4)]     = image.image_data_[i].red_;
+            (*bytes)[(i * 4) + 1] = image.image_data_[i].green_;
+            (*bytes)[(i * 4) + 2] = image.image_data_[i].blue_;
+            (*bytes)[(i * 4) + 3] = image.image_data_[i].alpha_;
+        }
+    }
+    return bytes;
+}
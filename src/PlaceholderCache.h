@@ -0,0 +1,153 @@
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifndef _PLACEHOLDERCACHE_H_
+#define _PLACEHOLDERCACHE_H_
+
+using namespace std;
+
+class CacheStats {
+    public:
+        uint64_t hits_; /* lookups answered from the cache */
+        uint64_t misses_; /* lookups that had to decode */
+        uint64_t evictions_; /* entries dropped to stay within capacity */
+        uint64_t entries_; /* entries currently cached */
+        uint64_t bytes_; /* bytes currently cached, keys included */
+
+        /**
+         * Constructs a CacheStats with every counter at 0.
+        */
+        CacheStats();
+};
+
+class PlaceholderCache {
+    public:
+        /**
+         * Constructs an empty cache.
+         * 
+         * @param capacity - the maximum number of bytes held across all shards
+         * @param shards - the number of independently locked shards, at least 1
+        */
+        PlaceholderCache(size_t capacity, unsigned int shards);
+
+        /**
+         * Decodes a ThumbHash to RGBA8 bytes, row by row, or returns the cached result.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image, or 0 for the default size
+         * @param height - the height of the decoded image, or 0 for the default size
+         * @returns the RGBA bytes, shared with the cache, empty if the hash is invalid
+        */
+        shared_ptr<const vector<unsigned char>> GetRGBA(vector<uint8_t> const & hash,
+                unsigned int width, unsigned int height);
+
+        /**
+         * Decodes a ThumbHash to RGBA8 bytes, optionally from linear light, or returns the cached
+         * result.
+         * Linear-light results are cached apart from sRGB ones.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image, or 0 for the default size
+         * @param height - the height of the decoded image, or 0 for the default size
+         * @param linear_light - true if the hash was encoded with linear_light set
+         * @returns the RGBA bytes, shared with the cache, empty if the hash is invalid
+        */
+        shared_ptr<const vector<unsigned char>> GetRGBA(vector<uint8_t> const & hash,
+                unsigned int width, unsigned int height, bool linear_light);
+
+        /**
+         * Decodes a ThumbHash and encodes it as a PNG, or returns the cached result.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image, or 0 for the default size
+         * @param height - the height of the decoded image, or 0 for the default size
+         * @returns the PNG bytes shared with the cache, empty if the hash is invalid or encoding failed
+        */
+        shared_ptr<const vector<unsigned char>> GetPNG(vector<uint8_t> const & hash,
+                unsigned int width, unsigned int height);
+
+        /**
+         * Decodes a ThumbHash and encodes it as a PNG, optionally from linear light, or returns the
+         * cached result.
+         * Linear-light results are cached apart from sRGB ones.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image, or 0 for the default size
+         * @param height - the height of the decoded image, or 0 for the default size
+         * @param linear_light - true if the hash was encoded with linear_light set
+         * @returns the PNG bytes shared with the cache, empty if the hash is invalid or encoding failed
+        */
+        shared_ptr<const vector<unsigned char>> GetPNG(vector<uint8_t> const & hash,
+                unsigned int width, unsigned int height, bool linear_light);
+
+        /**
+         * Decodes a ThumbHash into a PNG data URI, or returns the cached result.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image, or 0 for the default size
+         * @param height - the height of the decoded image, or 0 for the default size
+         * @returns the data URI, empty if the hash is invalid or encoding failed
+        */
+        string GetDataURI(vector<uint8_t> const & hash, unsigned int width, unsigned int height);
+
+        /**
+         * Decodes a ThumbHash into a PNG data URI, optionally from linear light, or returns the
+         * cached result.
+         * Linear-light results are cached apart from sRGB ones.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image, or 0 for the default size
+         * @param height - the height of the decoded image, or 0 for the default size
+         * @param linear_light - true if the hash was encoded with linear_light set
+         * @returns the data URI, empty if the hash is invalid or encoding failed
+        */
+        string GetDataURI(vector<uint8_t> const & hash, unsigned int width, unsigned int height,
+                bool linear_light);
+
+        /**
+         * Reads the cache counters. The counters are summed over shards without a global lock,
+         * so they are only a consistent snapshot when no other thread is using the cache.
+         * 
+         * @returns the current counters
+        */
+        CacheStats Stats() const;
+
+        /**
+         * Drops every entry. The hit, miss and eviction counters are kept.
+        */
+        void Clear();
+
+    private:
+        enum Kind { kRGBA = 0, kPNG = 1, kDataURI = 2 };
+        static const int kLinearLight = 4; /* or-ed into the kind byte of the key */
+
+        struct Entry {
+            string key;
+            shared_ptr<const vector<unsigned char>> value;
+        };
+
+        struct Shard {
+            mutex lock;
+            list<Entry> entries; /* most recently used first */
+            unordered_map<string, list<Entry>::iterator> index;
+            size_t bytes;
+        };
+
+        size_t shard_capacity_;
+        vector<unique_ptr<Shard>> shards_;
+        atomic<uint64_t> hits_;
+        atomic<uint64_t> misses_;
+        atomic<uint64_t> evictions_;
+
+        shared_ptr<const vector<unsigned char>> Get(Kind kind, vector<uint8_t> const & hash,
+                unsigned int width, unsigned int height, bool linear_light);
+        shared_ptr<const vector<unsigned char>> Render(Kind kind, vector<uint8_t> const & hash,
+                unsigned int width, unsigned int height, bool linear_light);
+};
+
+#endif
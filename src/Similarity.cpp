@@ -0,0 +1,83 @@
+#include "Similarity.h"
+#include "Thumbhash.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// offsets of each channel's triangle in HashVector::values_
+static const int kLOffset = 0;
+static const int kPOffset = kLOffset + HashVector::kLSize;
+static const int kQOffset = kPOffset + HashVector::kPQSize;
+static const int kAOffset = kQOffset + HashVector::kPQSize;
+
+const int HashVector::kLSize;
+const int HashVector::kPQSize;
+const int HashVector::kASize;
+const int HashVector::kSize;
+
+// index of (cx, cy) in the triangle cx + cy < n, stored row by row
+static inline int TriangleIndex(int n, int cx, int cy) {
+    return cy * n - cy * (cy - 1) / 2 + cx;
+}
+
+// dequantizes one channel's AC nibbles into its triangle, in the order Channel::Decode reads them
+static int UnpackChannel(vector<uint8_t> const & hash, int start, int index, int nx, int ny,
+        float dc, float scale, float weight, int n, float* out) {
+    float inner = sqrt(weight), edge = sqrt(2.0f * weight);
+    int count = Channel::CountAC(nx, ny);
+    float ac[HashVector::kLSize];
+    Channel::DequantizeNibbles(&hash[start], index, count, scale, ac);
+
+    out[0] = dc * inner;
+    for (int cy = 0, j = 0; cy < ny; cy++)
+        for (int cx = cy > 0 ? 0 : 1; cx * ny < nx * (ny - cy); cx++, j++)
+            out[TriangleIndex(n, cx, cy)] = ac[j] * (cx == 0 || cy == 0 ? edge : inner);
+    return index + count;
+}
+
+HashVector::HashVector() {
+    fill(values_, values_ + kSize, 0.0f);
+}
+
+bool HashVector::Unpack(vector<uint8_t> const & hash) {
+    ThumbHashHeader header;
+    if (!header.Parse(hash.data(), hash.size()) || hash.size() < header.HashSize())
+        return false;
+    int ac_start = header.ac_start_;
+
+    // channel weights: |rgb|^2 = 3 l^2 + 2/3 p^2 + 1/2 q^2, then averaged with a over 4 channels
+    fill(values_, values_ + kSize, 0.0f);
+    int ac_index = 0;
+    ac_index = UnpackChannel(hash, ac_start, ac_index, header.lx_, header.ly_, header.l_dc_, header.l_scale_,
+            3.0f / 4.0f, 7, values_ + kLOffset);
+    ac_index = UnpackChannel(hash, ac_start, ac_index, 3, 3, header.p_dc_, header.p_scale_ * 1.25f,
+            1.0f / 6.0f, 3, values_ + kPOffset);
+    ac_index = UnpackChannel(hash, ac_start, ac_index, 3, 3, header.q_dc_, header.q_scale_ * 1.25f,
+            1.0f / 8.0f, 3, values_ + kQOffset);
+    if (header.has_alpha_)
+        UnpackChannel(hash, ac_start, ac_index, 5, 5, header.a_dc_, header.a_scale_, 1.0f / 4.0f, 5,
+                values_ + kAOffset);
+    else
+        values_[kAOffset] = header.a_dc_ * 0.5f;
+    return true;
+}
+
+float HashVector::SquaredDistance(HashVector const & other) const {
+    // eight independent partial sums let the compiler vectorize without reassociating floats
+    float sums[8] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < kSize; i += 8) {
+        for (int k = 0; k < 8; k++) {
+            float difference = values_[i + k] - other.values_[i + k];
+            sums[k] += difference * difference;
+        }
+    }
+    return ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+}
+
+float ThumbHashDistance(vector<uint8_t> const & a, vector<uint8_t> const & b) {
+    HashVector first, second;
+    if (!first.Unpack(a) || !second.Unpack(b))
+        return -1.0f;
+    return sqrt(first.SquaredDistance(second));
+}
@@ -0,0 +1,58 @@
+#include <cstdint>
+#include <vector>
+#ifndef _SIMILARITY_H_
+#define _SIMILARITY_H_
+
+using namespace std;
+
+class HashVector {
+    public:
+        /*
+         * Layout: the DC and AC terms of each channel, in the triangle cx + cy < n row by row,
+         * with n = 7 for L, 3 for P and Q and 5 for A. Every ThumbHash channel fits in its
+         * triangle whatever its aspect ratio, so vectors of any two hashes line up term by term.
+        */
+        static const int kLSize = 28;
+        static const int kPQSize = 6;
+        static const int kASize = 15;
+        static const int kSize = 56; /* 55 terms padded to a multiple of 8 floats */
+
+        float values_[kSize]; /* the weighted, dequantized coefficients */
+
+        /**
+         * Constructs a zero vector.
+        */
+        HashVector();
+
+        /**
+         * Dequantizes a ThumbHash the way the decoder does, without rendering it.
+         * Each term is weighted so that the squared L2 distance between two vectors is the
+         * mean squared RGBA difference of the two decoded placeholders, before clamping:
+         * L, P and Q carry the weights of the LPQ to RGB transform (3, 2/3 and 1/2), and
+         * terms on the first row or column carry the factor 2 of their cosine energy.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @return true, if the hash was valid and has been unpacked.
+        */
+        bool Unpack(vector<uint8_t> const & hash);
+
+        /**
+         * Computes the squared L2 distance to another vector.
+         * 
+         * @param other - the other vector
+         * @returns the mean squared RGBA difference, in [0, 1] for unclamped colours
+        */
+        float SquaredDistance(HashVector const & other) const;
+};
+
+/**
+ * Approximates how different two placeholders look, directly from the hash bytes.
+ * 
+ * @param a - the first ThumbHash
+ * @param b - the second ThumbHash
+ * @returns the approximate RMS per-channel difference of the decoded RGBA images,
+ *          0 for identical hashes, or -1 if either hash is invalid
+*/
+float ThumbHashDistance(vector<uint8_t> const & a, vector<uint8_t> const & b);
+
+#endif
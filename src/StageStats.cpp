@@ -0,0 +1,248 @@
+#include "StageStats.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+const int StageStats::kStages;
+const int StageStats::kCounters;
+
+// one thread's running totals; only that thread writes them, so plain relaxed loads and stores suffice
+class ThreadTotals {
+    public:
+        atomic<uint64_t> calls_[StageStats::kStages];
+        atomic<uint64_t> nanos_[StageStats::kStages];
+        atomic<uint64_t> counts_[StageStats::kCounters];
+
+        ThreadTotals() {
+            for (int s = 0; s < StageStats::kStages; s++) {
+                calls_[s] = 0;
+                nanos_[s] = 0;
+            }
+            for (int c = 0; c < StageStats::kCounters; c++)
+                counts_[c] = 0;
+        }
+
+        void AddTo(StageStats& stats) const {
+            for (int s = 0; s < StageStats::kStages; s++) {
+                stats.calls_[s] += calls_[s].load(memory_order_relaxed);
+                stats.nanos_[s] += nanos_[s].load(memory_order_relaxed);
+            }
+            for (int c = 0; c < StageStats::kCounters; c++)
+                stats.counts_[c] += counts_[c].load(memory_order_relaxed);
+        }
+};
+
+static inline void Bump(atomic<uint64_t>& total, uint64_t amount) {
+    total.store(total.load(memory_order_relaxed) + amount, memory_order_relaxed);
+}
+
+// every live thread's totals, the totals of threads that have exited, and the Reset baseline
+class Registry {
+    public:
+        mutex lock_;
+        vector<ThreadTotals*> live_;
+        StageStats retired_;
+        StageStats baseline_;
+};
+
+static Registry& GlobalRegistry() {
+    static Registry* registry = new Registry(); // never destroyed, so late thread exits stay safe
+    return *registry;
+}
+
+// registers the calling thread's totals on first use, and folds them into retired_ when it exits
+class ThreadSlot {
+    public:
+        ThreadTotals* totals_;
+
+        ThreadSlot() {
+            totals_ = new ThreadTotals();
+            Registry& registry = GlobalRegistry();
+            lock_guard<mutex> guard(registry.lock_);
+            registry.live_.push_back(totals_);
+        }
+
+        ~ThreadSlot() {
+            Registry& registry = GlobalRegistry();
+            lock_guard<mutex> guard(registry.lock_);
+            totals_->AddTo(registry.retired_);
+            for (unsigned int i = 0; i < registry.live_.size(); i++)
+                if (registry.live_[i] == totals_) {
+                    registry.live_.erase(registry.live_.begin() + i);
+                    break;
+                }
+            delete totals_;
+        }
+};
+
+static ThreadTotals& LocalTotals() {
+    thread_local ThreadSlot slot;
+    return *slot.totals_;
+}
+
+StageStats::StageStats() {
+    for (int s = 0; s < kStages; s++) {
+        calls_[s] = 0;
+        nanos_[s] = 0;
+    }
+    for (int c = 0; c < kCounters; c++)
+        counts_[c] = 0;
+}
+
+StageStats StageStats::Collect() {
+    Registry& registry = GlobalRegistry();
+    lock_guard<mutex> guard(registry.lock_);
+    StageStats stats = registry.retired_;
+    for (unsigned int i = 0; i < registry.live_.size(); i++)
+        registry.live_[i]->AddTo(stats);
+    for (int s = 0; s < kStages; s++) {
+        stats.calls_[s] -= registry.baseline_.calls_[s];
+        stats.nanos_[s] -= registry.baseline_.nanos_[s];
+    }
+    for (int c = 0; c < kCounters; c++)
+        stats.counts_[c] -= registry.baseline_.counts_[c];
+    return stats;
+}
+
+void StageStats::Reset() {
+    // totals only ever grow, so a reset moves the baseline instead of racing the writers
+    Registry& registry = GlobalRegistry();
+    lock_guard<mutex> guard(registry.lock_);
+    StageStats stats = registry.retired_;
+    for (unsigned int i = 0; i < registry.live_.size(); i++)
+        registry.live_[i]->AddTo(stats);
+    registry.baseline_ = stats;
+}
+
+void StageStats::Record(Stage stage, uint64_t nanos) {
+    ThreadTotals& totals = LocalTotals();
+    Bump(totals.calls_[(int) stage], 1);
+    Bump(totals.nanos_[(int) stage], nanos);
+}
+
+void StageStats::Add(Counter counter, uint64_t amount) {
+    Bump(LocalTotals().counts_[(int) counter], amount);
+}
+
+bool StageStats::Enabled() {
+#ifdef THUMBHASH_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+string StageStats::ToPrometheus() const {
+    ostringstream text;
+    text << "# HELP thumbhash_stage_seconds_total Time spent in each stage.\n"
+            << "# TYPE thumbhash_stage_seconds_total counter\n";
+    for (int s = 0; s < kStages; s++)
+        text << "thumbhash_stage_seconds_total{stage=\"" << StageName((Stage) s) << "\"} "
+                << nanos_[s] / 1e9 << "\n";
+    text << "# HELP thumbhash_stage_calls_total Times each stage ran.\n"
+            << "# TYPE thumbhash_stage_calls_total counter\n";
+    for (int s = 0; s < kStages; s++)
+        text << "thumbhash_stage_calls_total{stage=\"" << StageName((Stage) s) << "\"} " << calls_[s] << "\n";
+    for (int c = 0; c < kCounters; c++) {
+        string name = "thumbhash_" + CounterName((Counter) c) + "_total";
+        text << "# TYPE " << name << " counter\n" << name << " " << counts_[c] << "\n";
+    }
+    return text.str();
+}
+
+string StageStats::ToJSON() const {
+    ostringstream json;
+    json << "{\"stages\": {";
+    for (int s = 0; s < kStages; s++)
+        json << (s > 0 ? ", " : "") << "\"" << StageName((Stage) s) << "\": {\"calls\": " << calls_[s]
+                << ", \"seconds\": " << nanos_[s] / 1e9 << "}";
+    json << "}, \"counters\": {";
+    for (int c = 0; c < kCounters; c++)
+        json << (c > 0 ? ", " : "") << "\"" << CounterName((Counter) c) << "\": " << counts_[c];
+    json << "}}\n";
+    return json.str();
+}
+
+string StageStats::StageName(Stage stage) {
+    static const char* names[] = { "file_read", "inflate", "repack", "convert", "transform", "pack", "decode" };
+    return names[(int) stage];
+}
+
+string StageStats::CounterName(Counter counter) {
+    static const char* names[] = {
+        "images_encoded", "pixels_encoded", "hashes_decoded", "pixels_decoded", "bytes_read"
+    };
+    return names[(int) counter];
+}
+
+StageTimer::StageTimer(Stage stage) {
+    stage_  = stage;
+    start_  = steady_clock::now();
+}
+
+void StageTimer::Next(Stage stage) {
+    steady_clock::time_point now = steady_clock::now();
+    StageStats::Record(stage_, duration_cast<nanoseconds>(now - start_).count());
+    stage_  = stage;
+    start_  = now;
+}
+
+StageTimer::~StageTimer() {
+    StageStats::Record(stage_, duration_cast<nanoseconds>(steady_clock::now() - start_).count());
+}
+
+StatsDumper::StatsDumper(string const & fileName, bool json, unsigned int seconds) {
+    file_name_  = fileName;
+    json_       = json;
+    seconds_    = max(1u, seconds);
+    stopping_   = false;
+    thread_     = thread([this] {
+        unique_lock<mutex> guard(lock_);
+        FileStatus status;
+        while (!wake_.wait_for(guard, std::chrono::seconds(seconds_), [this] { return stopping_; }))
+            Dump(status);
+    });
+}
+
+StatsDumper::~StatsDumper() {
+    {
+        lock_guard<mutex> guard(lock_);
+        stopping_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+    FileStatus status;
+    Dump(status);
+}
+
+bool StatsDumper::Dump(FileStatus& status) {
+    // one dump at a time, so concurrent calls never share the temporary file
+    lock_guard<mutex> guard(dump_lock_);
+    StageStats stats = StageStats::Collect();
+    string text = json_ ? stats.ToJSON() : stats.ToPrometheus();
+    string temporary = file_name_ + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "w");
+    if (!file) {
+        status = FileStatus(FileError::kWrite, temporary, strerror(errno));
+    } else {
+        bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+        written = fclose(file) == 0 && written;
+        if (!written || rename(temporary.c_str(), file_name_.c_str()) != 0)
+            status = FileStatus(FileError::kWrite, file_name_, strerror(errno));
+        else
+            status = FileStatus();
+    }
+    last_status_ = status;
+    return status.Ok();
+}
+
+FileStatus StatsDumper::LastStatus() {
+    lock_guard<mutex> guard(dump_lock_);
+    return last_status_;
+}
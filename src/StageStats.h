@@ -0,0 +1,193 @@
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "FileStatus.h"
+#ifndef _STAGESTATS_H_
+#define _STAGESTATS_H_
+
+using namespace std;
+
+/* the timed stages of reading, encoding and decoding an image */
+enum class Stage {
+    kFileRead, /* loading PNG bytes from disk */
+    kInflate, /* lodepng decompressing and unfiltering the PNG */
+    kRepack, /* copying decoded bytes into RGBAPixels */
+    kConvert, /* averaging and converting pixels to LPQA */
+    kTransform, /* the DCT of every channel */
+    kPack, /* quantizing and packing the hash */
+    kDecode /* rendering a hash back to pixels */
+};
+
+/* the event counts kept alongside the stage timers */
+enum class Counter {
+    kImagesEncoded,
+    kPixelsEncoded,
+    kHashesDecoded,
+    kPixelsDecoded,
+    kBytesRead
+};
+
+/*
+ * Instrumentation points compile to nothing unless THUMBHASH_STATS is defined (make STATS=1).
+ * A timer charges the time since it started, or since its last Next, to its current stage.
+ */
+#ifdef THUMBHASH_STATS
+#define THUMBHASH_TIMER(name, stage) StageTimer name(stage)
+#define THUMBHASH_NEXT_STAGE(name, stage) name.Next(stage)
+#define THUMBHASH_COUNT(counter, amount) StageStats::Add(counter, amount)
+#else
+#define THUMBHASH_TIMER(name, stage) ((void) 0)
+#define THUMBHASH_NEXT_STAGE(name, stage) ((void) 0)
+#define THUMBHASH_COUNT(counter, amount) ((void) 0)
+#endif
+
+class StageStats {
+    public:
+        static const int kStages = 7; /* the number of Stage values */
+        static const int kCounters = 5; /* the number of Counter values */
+
+        uint64_t calls_[kStages]; /* times each stage ran */
+        uint64_t nanos_[kStages]; /* nanoseconds spent in each stage */
+        uint64_t counts_[kCounters]; /* the total of each counter */
+
+        /**
+         * Constructs a StageStats with every total at 0.
+        */
+        StageStats();
+
+        /**
+         * Sums the totals of every thread, past and present, since the last Reset.
+         * Each thread writes only its own totals, so recording never takes a lock.
+         *
+         * @returns the totals
+        */
+        static StageStats Collect();
+
+        /**
+         * Starts the totals Collect reports over from 0.
+        */
+        static void Reset();
+
+        /**
+         * Charges time to a stage in the calling thread's totals.
+         *
+         * @param stage - the stage that ran
+         * @param nanos - how long it ran
+        */
+        static void Record(Stage stage, uint64_t nanos);
+
+        /**
+         * Adds to a counter in the calling thread's totals.
+         *
+         * @param counter - the counter to add to
+         * @param amount - the amount to add
+        */
+        static void Add(Counter counter, uint64_t amount);
+
+        /**
+         * @returns true, if the library was built with THUMBHASH_STATS and records anything
+        */
+        static bool Enabled();
+
+        /**
+         * Formats the totals in the Prometheus text exposition format, as
+         * thumbhash_stage_seconds_total, thumbhash_stage_calls_total and one
+         * thumbhash_<counter>_total per counter.
+         *
+         * @returns the metrics text
+        */
+        string ToPrometheus() const;
+
+        /**
+         * Formats the totals as a JSON object with "stages" and "counters" members.
+         *
+         * @returns the JSON text
+        */
+        string ToJSON() const;
+
+        /**
+         * @returns the snake_case name of a stage, such as "file_read"
+        */
+        static string StageName(Stage stage);
+
+        /**
+         * @returns the snake_case name of a counter, such as "images_encoded"
+        */
+        static string CounterName(Counter counter);
+};
+
+class StageTimer {
+    public:
+        /**
+         * Starts timing a stage.
+         *
+         * @param stage - the stage to charge until Next or destruction
+        */
+        StageTimer(Stage stage);
+
+        /**
+         * Charges the time so far to the current stage and starts timing another.
+         *
+         * @param stage - the stage to charge from now on
+        */
+        void Next(Stage stage);
+
+        /**
+         * Charges the time so far to the current stage.
+        */
+        ~StageTimer();
+
+    private:
+        Stage stage_;
+        chrono::steady_clock::time_point start_;
+};
+
+class StatsDumper {
+    public:
+        /**
+         * Starts a thread that rewrites a file with the current totals at a fixed interval,
+         * for example for the Prometheus node exporter's textfile collector. Each dump is
+         * written to a temporary file and renamed over the old one, so readers never see
+         * a partial file.
+         *
+         * @param fileName - the file to write
+         * @param json - true for JSON, false for the Prometheus text format
+         * @param seconds - the interval between dumps, at least 1
+        */
+        StatsDumper(string const & fileName, bool json, unsigned int seconds);
+
+        /**
+         * Writes a final dump and stops the thread.
+        */
+        ~StatsDumper();
+
+        /**
+         * Writes the current totals now. Safe to call from any thread; dumps are serialized
+         * with each other and with the timed ones, so they never tear the file.
+         *
+         * @param status - receives why the file could not be written
+         * @return true, if the file was written.
+        */
+        bool Dump(FileStatus& status);
+
+        /**
+         * @returns the outcome of the most recent dump, so failures of the timed dumps can be reported
+        */
+        FileStatus LastStatus();
+
+    private:
+        string file_name_;
+        bool json_;
+        unsigned int seconds_;
+        bool stopping_;
+        mutex lock_;
+        condition_variable wake_;
+        thread thread_;
+        mutex dump_lock_; /* held for a whole dump */
+        FileStatus last_status_; /* guarded by dump_lock_ */
+};
+
+#endif
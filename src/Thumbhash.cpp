@@ -1,29 +1,334 @@
 #include "Thumbhash.h"
+#include "StageStats.h"
 #include "../util/lodepng/Lodepng.h"
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
+#include <sstream>
 #include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <tmmintrin.h>
+#define THUMBHASH_SSSE3_DISPATCH
+#endif
 
 using namespace std;
 
-vector<uint8_t> ThumbHash::RGBAToThumbHash(Image image) {
-    unsigned int width = image.width_;
-    unsigned int height = image.height_;
-    vector<RGBAPixel> image_data = image.image_data_;
+const int ThumbHash::kMaxHashSize;
+const unsigned int ThumbHash::kMaxHashEdge;
 
-    if (width > 1000 || height > 1000)
+vector<uint8_t> ThumbHash::RGBAToThumbHash(Image const & image) {
+    uint8_t hash[kMaxHashSize];
+    size_t size = RGBAToThumbHash(image, hash);
+    return vector<uint8_t>(hash, hash + size);
+}
+
+vector<uint8_t> ThumbHash::RGBAToThumbHashDownscaled(Image const & image) {
+    if (image.width_ == 0 || image.height_ == 0)
         return vector<uint8_t>();
+    if (image.width_ <= kMaxHashEdge && image.height_ <= kMaxHashEdge)
+        return RGBAToThumbHash(image);
+    return RGBAToThumbHash(image.Downscale(kMaxHashEdge));
+}
+
+// 8-bit sRGB to linear light, built once so the pixel loops never call pow()
+static const float* SRGBToLinearTable() {
+    static const vector<float> table = [] {
+        vector<float> values(256);
+        for (int i = 0; i < 256; i++) {
+            double c = i / 255.0;
+            values[i] = (float) (c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+        }
+        return values;
+    }();
+    return &table[0];
+}
+
+// the linear values halfway between consecutive sRGB bytes, so a binary search rounds in sRGB
+static const float* LinearToSRGBThresholds() {
+    static const vector<float> table = [] {
+        vector<float> values(255);
+        for (int i = 0; i < 255; i++) {
+            double c = (i + 0.5) / 255.0;
+            values[i] = (float) (c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4));
+        }
+        return values;
+    }();
+    return &table[0];
+}
+
+// premultiplies an 8-bit sample by alpha, as a gamma-encoded or a linear-light value in [0, 1]
+static inline float Sample(float alpha, unsigned char value, const float* linear) {
+    return linear ? alpha * linear[value] : alpha / 255.0f * value;
+}
+
+// converts a linear-light value to an sRGB byte with eight comparisons
+static inline unsigned char ToSRGB(float value, const float* thresholds) {
+    return (unsigned char) (upper_bound(thresholds, thresholds + 255, value) - thresholds);
+}
+
+size_t ThumbHash::RGBAToThumbHash(Image const & image, uint8_t* hash) {
+    return RGBAToThumbHash(image, hash, false);
+}
+
+// reads the pixels of an Image as alpha and alpha-premultiplied colour, all in [0, 1]
+class ImageSource {
+    public:
+        const RGBAPixel* pixels_;
+        const float* linear_;
+
+        ImageSource(Image const & image, const float* linear) {
+            pixels_ = image.image_data_.data();
+            linear_ = linear;
+        }
+
+        bool IsGrey() const {
+            return false;
+        }
+
+        bool IsOpaque(unsigned int count) const {
+            for (unsigned int i = 0; i < count; i++)
+                if (pixels_[i].alpha_ != 255)
+                    return false;
+            return true;
+        }
+
+        void Read(unsigned int i, float& alpha, float& red, float& green, float& blue) const {
+            RGBAPixel const & pixel = pixels_[i];
+            alpha   = pixel.alpha_ / 255.0f;
+            red     = Sample(alpha, pixel.red_, linear_);
+            green   = Sample(alpha, pixel.green_, linear_);
+            blue    = Sample(alpha, pixel.blue_, linear_);
+        }
+
+        void ReadOpaque(unsigned int i, float& red, float& green, float& blue) const {
+            RGBAPixel const & pixel = pixels_[i];
+            red     = Sample(1.0f, pixel.red_, linear_);
+            green   = Sample(1.0f, pixel.green_, linear_);
+            blue    = Sample(1.0f, pixel.blue_, linear_);
+        }
+};
+
+// checks that every alpha sample of count pixels is at its maximum; alpha_at and alpha_bytes
+// locate the alpha sample in a pixel of stride bytes, and the stride must divide 16
+static bool AlphaIsOpaque(const unsigned char* data, size_t count, unsigned int stride,
+        unsigned int alpha_at, unsigned int alpha_bytes) {
+    unsigned char mask[16];
+    for (unsigned int lane = 0; lane < 16; lane++)
+        mask[lane] = lane % stride >= alpha_at && lane % stride < alpha_at + alpha_bytes ? 255 : 0;
+    size_t size = count * stride, i = 0;
+    unsigned char folded[16];
+    memset(folded, 255, sizeof(folded));
+#ifdef __SSE2__
+    // AND whole blocks together, so each lane keeps the bits set in every byte at its offset,
+    // and give up at the first kilobyte that shows a transparent pixel
+    const __m128i ones = _mm_set1_epi8(-1);
+    const __m128i not_alpha = _mm_xor_si128(_mm_loadu_si128((const __m128i*) mask), ones);
+    __m128i all = ones;
+    for (; i + 16 <= size; i += 16) {
+        all = _mm_and_si128(all, _mm_loadu_si128((const __m128i*) (data + i)));
+        if ((i & 1023) == 1008
+                && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(all, not_alpha), ones)) != 0xFFFF)
+            return false;
+    }
+    _mm_storeu_si128((__m128i*) folded, all);
+#endif
+    for (; i < size; i++)
+        folded[i % 16] &= data[i];
+    for (unsigned int lane = 0; lane < 16; lane++)
+        if ((folded[lane] & mask[lane]) != mask[lane])
+            return false;
+    return true;
+}
+
+// reads the samples of a PixelImage like ImageSource: kBytes is 1 or 2 (big-endian),
+// and kChannels is 1 (grey), 2 (grey-alpha), 3 (RGB) or 4 (RGBA)
+template <int kBytes, int kChannels>
+class PackedSource {
+    public:
+        const unsigned char* data_;
+
+        PackedSource(const unsigned char* data) {
+            data_ = data;
+        }
+
+        bool IsGrey() const {
+            return kChannels < 3;
+        }
+
+        bool IsOpaque(unsigned int count) const {
+            return kChannels % 2 == 1
+                    || AlphaIsOpaque(data_, count, kBytes * kChannels, (kChannels - 1) * kBytes, kBytes);
+        }
+
+        static unsigned int Value(const unsigned char* sample) {
+            return kBytes == 2 ? (sample[0] << 8) | sample[1] : sample[0];
+        }
+
+        void Read(unsigned int i, float& alpha, float& red, float& green, float& blue) const {
+            const float max_value = kBytes == 2 ? 65535.0f : 255.0f;
+            const unsigned char* pixel = data_ + i * kBytes * kChannels;
+            alpha = kChannels % 2 == 0 ? Value(pixel + (kChannels - 1) * kBytes) / max_value : 1.0f;
+            if (kChannels < 3) {
+                red = green = blue = alpha / max_value * Value(pixel);
+            } else {
+                red     = alpha / max_value * Value(pixel);
+                green   = alpha / max_value * Value(pixel + kBytes);
+                blue    = alpha / max_value * Value(pixel + 2 * kBytes);
+            }
+        }
+
+        void ReadOpaque(unsigned int i, float& red, float& green, float& blue) const {
+            const float unit = 1.0f / (kBytes == 2 ? 65535.0f : 255.0f);
+            const unsigned char* pixel = data_ + i * kBytes * kChannels;
+            if (kChannels < 3) {
+                red = green = blue = unit * Value(pixel);
+            } else {
+                red     = unit * Value(pixel);
+                green   = unit * Value(pixel + kBytes);
+                blue    = unit * Value(pixel + 2 * kBytes);
+            }
+        }
+};
+
+// reads the index bytes of a kPalette8 PixelImage, with each palette entry converted once
+class PaletteSource {
+    public:
+        const unsigned char* indices_;
+        float alpha_[256];
+        float red_[256];
+        float green_[256];
+        float blue_[256];
+        bool grey_;
+        bool opaque_;
+
+        PaletteSource(PixelImage const & image) {
+            indices_ = image.data_.data();
+            grey_ = true;
+            opaque_ = true;
+            for (int e = 0; e < 256; e++) {
+                const unsigned char* entry = &image.palette_[e * 4];
+                alpha_[e]   = entry[3] / 255.0f;
+                red_[e]     = alpha_[e] / 255.0f * entry[0];
+                green_[e]   = alpha_[e] / 255.0f * entry[1];
+                blue_[e]    = alpha_[e] / 255.0f * entry[2];
+                grey_ = grey_ && entry[0] == entry[1] && entry[1] == entry[2];
+                opaque_ = opaque_ && entry[3] == 255;
+            }
+        }
+
+        bool IsGrey() const {
+            return grey_;
+        }
+
+        bool IsOpaque(unsigned int) const {
+            return opaque_;
+        }
+
+        void Read(unsigned int i, float& alpha, float& red, float& green, float& blue) const {
+            unsigned int e = indices_[i];
+            alpha   = alpha_[e];
+            red     = red_[e];
+            green   = green_[e];
+            blue    = blue_[e];
+        }
+
+        void ReadOpaque(unsigned int i, float& red, float& green, float& blue) const {
+            unsigned int e = indices_[i];
+            red     = red_[e];
+            green   = green_[e];
+            blue    = blue_[e];
+        }
+};
+
+// converts one premultiplied pixel to LPQA; blends it over the average colour unless the
+// image is opaque, and leaves a unwritten then. p and q may be null
+template <bool kOpaque>
+static inline void BlendToLPQA(float avg_red, float avg_green, float avg_blue,
+        float alpha, float red, float green, float blue, float* l, float* p, float* q, float* a) {
+    if (!kOpaque) {
+        red     = avg_red   * (1.0f - alpha) + red;
+        green   = avg_green * (1.0f - alpha) + green;
+        blue    = avg_blue  * (1.0f - alpha) + blue;
+        *a = alpha;
+    }
+    *l = (red + green + blue) / 3.0f;
+    if (p) {
+        *p = (red + green) / 2.0f - blue;
+        *q = red - green;
+    }
+}
+
+// converts every pixel of a source to LPQA planes; p and q are null when the source is grey,
+// and a is unused when kOpaque is set
+template <bool kOpaque, class Source>
+static void ConvertToLPQA(Source const & source, unsigned int count, float avg_red, float avg_green,
+        float avg_blue, float* l, float* p, float* q, float* a) {
+    for (unsigned int i = 0; i < count; i++) {
+        float alpha = 1.0f, red, green, blue;
+        if (kOpaque)
+            source.ReadOpaque(i, red, green, blue);
+        else
+            source.Read(i, alpha, red, green, blue);
+        BlendToLPQA<kOpaque>(avg_red, avg_green, avg_blue, alpha, red, green, blue,
+                l + i, p ? p + i : nullptr, q ? q + i : nullptr, kOpaque ? nullptr : a + i);
+    }
+}
+
+// converts the 256 palette entries once, then every pixel is a lookup
+template <bool kOpaque>
+static void ConvertToLPQA(PaletteSource const & source, unsigned int count, float avg_red, float avg_green,
+        float avg_blue, float* l, float* p, float* q, float* a) {
+    float entry_l[256], entry_p[256], entry_q[256], entry_a[256];
+    for (int e = 0; e < 256; e++)
+        BlendToLPQA<kOpaque>(avg_red, avg_green, avg_blue, source.alpha_[e], source.red_[e], source.green_[e],
+                source.blue_[e], entry_l + e, entry_p + e, entry_q + e, entry_a + e);
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int e = source.indices_[i];
+        l[i] = entry_l[e];
+        if (p) {
+            p[i] = entry_p[e];
+            q[i] = entry_q[e];
+        }
+        if (!kOpaque)
+            a[i] = entry_a[e];
+    }
+}
 
-    // compute average colour
+// the float encoder, reading every pixel through source.Read so any layout is converted in its own passes
+template <class Source>
+static size_t EncodeSource(Source const & source, unsigned int width, unsigned int height, uint8_t* hash,
+        ThumbHashScratch& scratch) {
+    if (width > 1000 || height > 1000)
+        return 0;
+    THUMBHASH_TIMER(timer, Stage::kConvert);
+    THUMBHASH_COUNT(Counter::kImagesEncoded, 1);
+    THUMBHASH_COUNT(Counter::kPixelsEncoded, width * height);
+
+    // compute average colour; opaque images skip alpha entirely
+    bool is_opaque = source.IsOpaque(width * height);
     float avg_red = 0, avg_green = 0, avg_blue = 0, avg_alpha = 0;
-    for (unsigned int i = 0; i < width * height; i++) {
-        RGBAPixel curr_pixel = image_data[i];
-        float alpha = curr_pixel.alpha_ / 255.0f;
-        avg_red     += alpha / 255.0f * curr_pixel.red_;
-        avg_green   += alpha / 255.0f * curr_pixel.green_;
-        avg_blue    += alpha / 255.0f * curr_pixel.blue_;
-        avg_alpha   += alpha;
+    if (is_opaque) {
+        for (unsigned int i = 0; i < width * height; i++) {
+            float red, green, blue;
+            source.ReadOpaque(i, red, green, blue);
+            avg_red     += red;
+            avg_green   += green;
+            avg_blue    += blue;
+        }
+        avg_alpha = (float) (width * height);
+    } else {
+        for (unsigned int i = 0; i < width * height; i++) {
+            float alpha, red, green, blue;
+            source.Read(i, alpha, red, green, blue);
+            avg_red     += red;
+            avg_green   += green;
+            avg_blue    += blue;
+            avg_alpha   += alpha;
+        }
     }
     if (avg_alpha > 0) {
         avg_red     /= avg_alpha;
@@ -36,31 +341,49 @@ vector<uint8_t> ThumbHash::RGBAToThumbHash(Image image) {
     int lx = max(1, (int) round((float) (l_limit * width) / (float) max(width, height)));
     int ly = max(1, (int) round((float) (l_limit * height) / (float) max(width, height)));
 
-    vector<float> l(width * height); // luminance
-    vector<float> p(width * height); // yellow - blue
-    vector<float> q(width * height); // red - green
-    vector<float> a(width * height); // alpha
+    // grey pixels have p and q exactly zero, which a freshly reset Channel already holds
+    bool is_grey = source.IsGrey();
+    // every sample of a plane in use is overwritten below, so reused planes need no clearing
+    vector<float>& l = scratch.l_; // luminance
+    vector<float>& p = scratch.p_; // yellow - blue
+    vector<float>& q = scratch.q_; // red - green
+    vector<float>& a = scratch.a_; // alpha
+    l.resize(width * height);
+    if (!is_grey) {
+        p.resize(width * height);
+        q.resize(width * height);
+    }
+    if (!is_opaque)
+        a.resize(width * height);
 
     // convert image from rgba to lpqa
-    for (unsigned int i = 0; i < width * height; i++) {
-        RGBAPixel curr_pixel = image_data[i];
-        float alpha = curr_pixel.alpha_ / 255.0f;
-        float red   = avg_red   * (1.0f - alpha) + alpha / 255.0f * curr_pixel.red_;
-        float green = avg_green * (1.0f - alpha) + alpha / 255.0f * curr_pixel.green_;
-        float blue  = avg_blue  * (1.0f - alpha) + alpha / 255.0f * curr_pixel.blue_;
-        l[i] = (red + green + blue) / 3.0f;
-        p[i] = (red + green) / 2.0f - blue;
-        q[i] = red - green;
-        a[i] = alpha;
-    }
-
-    // encode values using DCT
-    Channel *l_channel = (new Channel(max(3, lx), max(3, ly)))->Encode(width, height, l);
-    Channel *p_channel = (new Channel(3, 3))->Encode(width, height, p);
-    Channel *q_channel = (new Channel(3, 3))->Encode(width, height, q);
-    Channel *a_channel = has_alpha ? (new Channel(5, 5))->Encode(width, height, a) : nullptr;
+    if (is_opaque)
+        ConvertToLPQA<true>(source, width * height, avg_red, avg_green, avg_blue,
+                l.data(), is_grey ? nullptr : p.data(), is_grey ? nullptr : q.data(), nullptr);
+    else
+        ConvertToLPQA<false>(source, width * height, avg_red, avg_green, avg_blue,
+                l.data(), is_grey ? nullptr : p.data(), is_grey ? nullptr : q.data(), a.data());
+
+    // encode values using DCT, into the scratch channels
+    THUMBHASH_NEXT_STAGE(timer, Stage::kTransform);
+    Channel *l_channel = &scratch.l_channel_;
+    Channel *p_channel = &scratch.p_channel_;
+    Channel *q_channel = &scratch.q_channel_;
+    Channel *a_channel = &scratch.a_channel_;
+    l_channel->Reset(max(3, lx), max(3, ly));
+    p_channel->Reset(3, 3);
+    q_channel->Reset(3, 3);
+    a_channel->Reset(5, 5);
+    l_channel->Encode(width, height, l, scratch.fx_);
+    if (!is_grey) {
+        p_channel->Encode(width, height, p, scratch.fx_);
+        q_channel->Encode(width, height, q, scratch.fx_);
+    }
+    if (has_alpha)
+        a_channel->Encode(width, height, a, scratch.fx_);
 
     // write constants
+    THUMBHASH_NEXT_STAGE(timer, Stage::kPack);
     bool is_landscape = width > height;
     int header24 = ((int) round(63.0f * l_channel->dc_))
             | (((int) round(31.5f + 31.5f * p_channel->dc_)) << 6)
@@ -74,7 +397,7 @@ vector<uint8_t> ThumbHash::RGBAToThumbHash(Image image) {
     int ac_start = has_alpha ? 6 : 5;
     int ac_count = l_channel->ac_.size() + p_channel->ac_.size() + q_channel->ac_.size()
             + (has_alpha ? a_channel->ac_.size() : 0);
-    vector<uint8_t> hash(ac_start + (ac_count + 1) / 2);
+    int hash_size = ac_start + (ac_count + 1) / 2;
     hash[0] = (uint8_t) header24;
     hash[1] = (uint8_t) (header24 >> 8);
     hash[2] = (uint8_t) (header24 >> 16);
@@ -83,71 +406,281 @@ vector<uint8_t> ThumbHash::RGBAToThumbHash(Image image) {
     if (has_alpha) hash[5] = (uint8_t) (((int) round(15.0f * a_channel->dc_))
             | (((int) round(15.0f * a_channel->scale_)) << 4));
 
-    // Write the varying factors
-    int ac_index = 0;
-    ac_index = l_channel->Write(hash, ac_start, ac_index);
-    ac_index = p_channel->Write(hash, ac_start, ac_index);
-    ac_index = q_channel->Write(hash, ac_start, ac_index);
-    if (has_alpha) a_channel->Write(hash, ac_start, ac_index);
-    delete l_channel;
-    delete p_channel;
-    delete q_channel;
-    delete a_channel;
+    // gather the varying factors of every channel, then quantize and pack them in one pass
+    float ac[ThumbHash::kMaxHashSize * 2];
+    float *ac_end = copy(l_channel->ac_.begin(), l_channel->ac_.end(), ac);
+    ac_end = copy(p_channel->ac_.begin(), p_channel->ac_.end(), ac_end);
+    ac_end = copy(q_channel->ac_.begin(), q_channel->ac_.end(), ac_end);
+    if (has_alpha) copy(a_channel->ac_.begin(), a_channel->ac_.end(), ac_end);
+    Channel::QuantizeNibbles(ac, ac_count, hash + ac_start);
 
-    return hash;
+    return hash_size;
 }
 
-Image ThumbHash::ThumbHashToRGBA(vector<uint8_t> hash) {
-    int header24 = (hash[0] & 255) | ((hash[1] & 255) << 8) | ((hash[2] & 255) << 16);
-    int header16 = (hash[3] & 255) | ((hash[4] & 255) << 8);
-    float l_dc = (float) (header24 & 63) / 63.0f;
-    float p_dc = (float) ((header24 >> 6) & 63) / 31.5f - 1.0f;
-    float q_dc = (float) ((header24 >> 12) & 63) / 31.5f - 1.0f;
-    float l_scale = (float) ((header24 >> 18) & 31) / 31.0f;
-    bool has_alpha = (header24 >> 23) != 0;
-    float p_scale = (float) ((header16 >> 3) & 63) / 63.0f;
-    float q_scale = (float) ((header16 >> 9) & 63) / 63.0f;
-    bool is_landscape = (header16 >> 15) != 0;
-    int lx = max(3, is_landscape ? has_alpha ? 5 : 7 : header16 & 7);
-    int ly = max(3, is_landscape ? header16 & 7 : has_alpha ? 5 : 7);
-    float a_dc = has_alpha ? (float) (hash[5] & 15) / 15.0f : 1.0f;
-    float a_scale = (float) ((hash[5] >> 4) & 15) / 15.0f;
-
-    // compute size of l_ac
-    int n = 0;
-    for (int cy = 0; cy < ly; cy++)
-        for (int cx = cy > 0 ? 0 : 1; cx * ly < lx * (ly - cy); cx++)
-            n++;
+size_t ThumbHash::RGBAToThumbHash(Image const & image, uint8_t* hash, bool linear_light) {
+    ThumbHashScratch scratch;
+    return RGBAToThumbHash(image, hash, linear_light, scratch);
+}
+
+size_t ThumbHash::RGBAToThumbHash(Image const & image, uint8_t* hash, bool linear_light,
+        ThumbHashScratch& scratch) {
+    const float* linear = linear_light ? SRGBToLinearTable() : nullptr;
+    return EncodeSource(ImageSource(image, linear), image.width_, image.height_, hash, scratch);
+}
+
+size_t ThumbHash::RGBAToThumbHash(PixelImage const & image, uint8_t* hash) {
+    ThumbHashScratch scratch;
+    return RGBAToThumbHash(image, hash, scratch);
+}
+
+size_t ThumbHash::RGBAToThumbHash(PixelImage const & image, uint8_t* hash, ThumbHashScratch& scratch) {
+    if (image.data_.size() < (size_t) image.width_ * image.height_ * image.BytesPerPixel())
+        return 0;
+    const unsigned char* data = image.data_.data();
+    unsigned int width = image.width_;
+    unsigned int height = image.height_;
+    switch (image.format_) {
+        case PixelFormat::kGrey8:       return EncodeSource(PackedSource<1, 1>(data), width, height, hash, scratch);
+        case PixelFormat::kGrey16:      return EncodeSource(PackedSource<2, 1>(data), width, height, hash, scratch);
+        case PixelFormat::kGreyAlpha8:  return EncodeSource(PackedSource<1, 2>(data), width, height, hash, scratch);
+        case PixelFormat::kGreyAlpha16: return EncodeSource(PackedSource<2, 2>(data), width, height, hash, scratch);
+        case PixelFormat::kRGB8:        return EncodeSource(PackedSource<1, 3>(data), width, height, hash, scratch);
+        case PixelFormat::kRGB16:       return EncodeSource(PackedSource<2, 3>(data), width, height, hash, scratch);
+        case PixelFormat::kRGBA8:       return EncodeSource(PackedSource<1, 4>(data), width, height, hash, scratch);
+        case PixelFormat::kRGBA16:      return EncodeSource(PackedSource<2, 4>(data), width, height, hash, scratch);
+        case PixelFormat::kPalette8:
+            if (image.palette_.size() < 256 * 4)
+                return 0;
+            return EncodeSource(PaletteSource(image), width, height, hash, scratch);
+    }
+    return 0;
+}
+
+// divides and rounds half away from zero, for any sign of num and den > 0
+static inline int64_t RoundDiv(int64_t num, int64_t den) {
+    return num >= 0 ? (2 * num + den) / (2 * den) : -((-2 * num + den) / (2 * den));
+}
+
+// cos(pi * k / n) in Q15, from integer arithmetic only so that every platform gets the same table
+static int32_t FixedCos(int64_t k, int64_t n) {
+    static const int64_t kPi = 1686629713; // round(pi * 2^29)
+    int64_t m = k % (2 * n);
+    if (m > n) m = 2 * n - m; // cos(2 pi - t) = cos(t)
+    int sign = 1;
+    if (2 * m > n) { // cos(pi - t) = -cos(t)
+        m = n - m;
+        sign = -1;
+    }
+
+    // Taylor series in Q29 on [0, pi / 2]; the x^18 term is below 2^-40
+    int64_t x = RoundDiv(kPi * m, n);
+    int64_t x2 = RoundDiv(x * x, 1LL << 29);
+    int64_t term = 1LL << 29, sum = term;
+    for (int i = 1; i <= 9; i++) {
+        term = -RoundDiv(RoundDiv(term * x2, 1LL << 29), (2 * i - 1) * (2 * i));
+        sum += term;
+    }
+    return sign * (int32_t) RoundDiv(sum, 1 << 14);
+}
+
+size_t ThumbHash::RGBAToThumbHashFixedPoint(Image const & image, uint8_t* hash) {
+    ThumbHashScratch scratch;
+    return RGBAToThumbHashFixedPoint(image, hash, scratch);
+}
+
+size_t ThumbHash::RGBAToThumbHashFixedPoint(Image const & image, uint8_t* hash, ThumbHashScratch& scratch) {
+    int width = image.width_;
+    int height = image.height_;
+    vector<RGBAPixel> const & image_data = image.image_data_;
+
+    if (width > 1000 || height > 1000 || width * height == 0)
+        return 0;
+    THUMBHASH_TIMER(timer, Stage::kConvert);
+    THUMBHASH_COUNT(Counter::kImagesEncoded, 1);
+    THUMBHASH_COUNT(Counter::kPixelsEncoded, width * height);
+
+    // compute average colour as integers: sum of a * c over sum of a, kept in 1/256 steps
+    int64_t sum_red = 0, sum_green = 0, sum_blue = 0, sum_alpha = 0;
+    for (int i = 0; i < width * height; i++) {
+        int alpha = (int) image_data[i].alpha_;
+        sum_red     += alpha * image_data[i].red_;
+        sum_green   += alpha * image_data[i].green_;
+        sum_blue    += alpha * image_data[i].blue_;
+        sum_alpha   += alpha;
+    }
+    int64_t avg_red = sum_alpha > 0 ? RoundDiv(sum_red * 256, sum_alpha) : 0;
+    int64_t avg_green = sum_alpha > 0 ? RoundDiv(sum_green * 256, sum_alpha) : 0;
+    int64_t avg_blue = sum_alpha > 0 ? RoundDiv(sum_blue * 256, sum_alpha) : 0;
+
+    bool has_alpha = sum_alpha < 255LL * width * height;
+    int l_limit = has_alpha ? 5 : 7; // if there's alpha use less luminance bits
+    int lx = max(1, (int) RoundDiv(l_limit * width, max(width, height)));
+    int ly = max(1, (int) RoundDiv(l_limit * height, max(width, height)));
+    int l_nx = max(3, lx), l_ny = max(3, ly);
+
+    // precomputed Q15 cosine tables, cos(pi / width * cx * (x + 0.5)) = cos(pi * cx * (2x + 1) / 2width)
+    const int kOrders = 7;
+    vector<int32_t>& fx = scratch.fixed_fx_;
+    vector<int32_t>& fy = scratch.fixed_fy_;
+    fx.resize(kOrders * width);
+    fy.resize(kOrders * height);
+    for (int cx = 0; cx < kOrders; cx++)
+        for (int x = 0; x < width; x++)
+            fx[cx * width + x] = FixedCos(cx * (2 * x + 1), 2 * width);
+    for (int cy = 0; cy < kOrders; cy++)
+        for (int y = 0; y < height; y++)
+            fy[cy * height + y] = FixedCos(cy * (2 * y + 1), 2 * height);
+
+    // one fused pass: blend and convert each pixel to LPQA, then run the separable DCT.
+    THUMBHASH_NEXT_STAGE(timer, Stage::kTransform);
+    // l, p and q are scaled by K = 6 * 255 * 255 * 256 and a by 255, so every step is exact.
+    const int kChannels = 4;
+    int nx[kChannels] = { l_nx, 3, 3, 5 }, ny[kChannels] = { l_ny, 3, 3, 5 };
+    int64_t row[kChannels][kOrders];
+    int64_t total[kChannels][kOrders][kOrders] = {};
+    for (int y = 0; y < height; y++) {
+        fill(&row[0][0], &row[0][0] + kChannels * kOrders, 0);
+        for (int x = 0; x < width; x++) {
+            RGBAPixel const & pixel = image_data[x + y * width];
+            int64_t alpha = (int64_t) pixel.alpha_;
+            int64_t red     = avg_red   * (255 - alpha) + alpha * pixel.red_ * 256;
+            int64_t green   = avg_green * (255 - alpha) + alpha * pixel.green_ * 256;
+            int64_t blue    = avg_blue  * (255 - alpha) + alpha * pixel.blue_ * 256;
+            int64_t values[kChannels] = {
+                2 * (red + green + blue),
+                3 * (red + green) - 6 * blue,
+                6 * (red - green),
+                alpha };
+            for (int c = 0; c < kChannels; c++)
+                for (int cx = 0; cx < nx[c]; cx++)
+                    row[c][cx] += values[c] * fx[cx * width + x];
+        }
+        for (int c = 0; c < kChannels; c++)
+            for (int cy = 0; cy < ny[c]; cy++)
+                for (int cx = 0; cx < nx[c]; cx++)
+                    total[c][cy][cx] += RoundDiv(row[c][cx], 1 << 15) * fy[cy * height + y];
+    }
+
+    // average per pixel, then collect DC, AC and the largest AC magnitude in hash order
+    int64_t dc[kChannels], scale[kChannels] = {};
+    int64_t ac[kChannels][kOrders * kOrders];
+    int ac_size[kChannels] = {};
+    for (int c = 0; c < kChannels; c++) {
+        for (int cy = 0; cy < ny[c]; cy++) {
+            for (int cx = 0; cx * ny[c] < nx[c] * (ny[c] - cy); cx++) {
+                int64_t f = RoundDiv(total[c][cy][cx], (int64_t) width * height);
+                if (cx > 0 || cy > 0) {
+                    ac[c][ac_size[c]++] = f;
+                    scale[c] = max(scale[c], f < 0 ? -f : f);
+                } else {
+                    dc[c] = f;
+                }
+            }
+        }
+    }
 
-    // read the varying factors and boost saturation by 1.25x to compensate for quantization
+    // write constants; unit is the fixed-point value of 1.0 after the DCT
+    THUMBHASH_NEXT_STAGE(timer, Stage::kPack);
+    const int64_t unit = 6LL * 255 * 255 * 256 << 15, alpha_unit = 255LL << 15;
+    bool is_landscape = width > height;
+    int header24 = (int) min((int64_t) 63, max((int64_t) 0, RoundDiv(63 * dc[0], unit)))
+            | ((int) min((int64_t) 63, max((int64_t) 0, RoundDiv(63 * (unit + dc[1]), 2 * unit))) << 6)
+            | ((int) min((int64_t) 63, max((int64_t) 0, RoundDiv(63 * (unit + dc[2]), 2 * unit))) << 12)
+            | ((int) min((int64_t) 31, RoundDiv(31 * scale[0], unit)) << 18)
+            | (has_alpha ? 1 << 23 : 0);
+    int header16 = (is_landscape ? ly : lx)
+            | ((int) min((int64_t) 63, RoundDiv(63 * scale[1], unit)) << 3)
+            | ((int) min((int64_t) 63, RoundDiv(63 * scale[2], unit)) << 9)
+            | (is_landscape ? 1 << 15 : 0);
     int ac_start = has_alpha ? 6 : 5;
-    int ac_index = 0;
-    Channel *l_channel = new Channel(lx, ly);
-    Channel *p_channel = new Channel(3, 3);
-    Channel *q_channel = new Channel(3, 3);
-    Channel *a_channel = nullptr;
-    ac_index = l_channel->Decode(hash, ac_start, ac_index, l_scale);
-    ac_index = p_channel->Decode(hash, ac_start, ac_index, p_scale * 1.25f);
-    ac_index = q_channel->Decode(hash, ac_start, ac_index, q_scale * 1.25f);
-    if (has_alpha) {
-        a_channel = new Channel(5, 5);
-        a_channel->Decode(hash, ac_start, ac_index, a_scale);
-    }
-    vector<float> l_ac = l_channel->ac_;
-    vector<float> p_ac = p_channel->ac_;
-    vector<float> q_ac = q_channel->ac_;
-    vector<float> a_ac = has_alpha ? a_channel->ac_ : vector<float>();
-
-    // decode to RGB using the DCT
+    int ac_count = ac_size[0] + ac_size[1] + ac_size[2] + (has_alpha ? ac_size[3] : 0);
+    hash[0] = (uint8_t) header24;
+    hash[1] = (uint8_t) (header24 >> 8);
+    hash[2] = (uint8_t) (header24 >> 16);
+    hash[3] = (uint8_t) header16;
+    hash[4] = (uint8_t) (header16 >> 8);
+    if (has_alpha) hash[5] = (uint8_t) (min((int64_t) 15, max((int64_t) 0, RoundDiv(15 * dc[3], alpha_unit)))
+            | (min((int64_t) 15, RoundDiv(15 * scale[3], alpha_unit)) << 4));
+
+    // write the varying factors, round(15 * (0.5 + 0.5 * ac / scale)) as an exact ratio
+    for (int c = 0, index = 0; c < (has_alpha ? 4 : 3); c++) {
+        for (int i = 0; i < ac_size[c]; i++, index++) {
+            int nibble = scale[c] > 0
+                    ? (int) min((int64_t) 15, max((int64_t) 0, RoundDiv(15 * (scale[c] + ac[c][i]), 2 * scale[c])))
+                    : 0;
+            if (index & 1)
+                hash[ac_start + (index >> 1)] |= nibble << 4;
+            else
+                hash[ac_start + (index >> 1)] = nibble;
+        }
+    }
+    return ac_start + (ac_count + 1) / 2;
+}
+
+vector<uint8_t> ThumbHash::RGBAToThumbHashFixedPoint(Image const & image) {
+    uint8_t hash[kMaxHashSize];
+    size_t size = RGBAToThumbHashFixedPoint(image, hash);
+    return vector<uint8_t>(hash, hash + size);
+}
+
+Image ThumbHash::ThumbHashToRGBA(vector<uint8_t> const & hash) {
     float ratio = ThumbHashToApproximateAspectRatio(hash);
     unsigned int width = round(ratio > 1.0f ? 32.0f : 32.0f * ratio);
     unsigned int height = round(ratio > 1.0f ? 32.0f / ratio : 32.0f); 
+    return ThumbHashToRGBA(hash, width, height);
+}
+
+Image ThumbHash::ThumbHashToRGBA(vector<uint8_t> const & hash, unsigned int width, unsigned int height) {
+    return ThumbHashToRGBA(hash, width, height, false);
+}
 
-    vector<RGBAPixel> image_data(width * height);
+Image ThumbHash::ThumbHashToRGBA(vector<uint8_t> const & hash, unsigned int width, unsigned int height,
+        bool linear_light) {
+    Image image;
+    ThumbHashToRGBA(hash, width, height, linear_light, image);
+    return image;
+}
+
+void ThumbHash::ThumbHashToRGBA(vector<uint8_t> const & hash, unsigned int width, unsigned int height,
+        bool linear_light, Image& image) {
+    THUMBHASH_TIMER(timer, Stage::kDecode);
+    THUMBHASH_COUNT(Counter::kHashesDecoded, 1);
+    THUMBHASH_COUNT(Counter::kPixelsDecoded, width * height);
+    const float* thresholds = linear_light ? LinearToSRGBThresholds() : nullptr;
+    ThumbHashHeader header;
+    // a truncated hash decodes to its DC colour rather than reading past the end
+    bool complete = header.Parse(hash.data(), hash.size()) && hash.size() >= header.HashSize();
+    bool has_alpha = header.has_alpha_;
+    int lx = header.lx_, ly = header.ly_;
+    float l_dc = header.l_dc_, p_dc = header.p_dc_, q_dc = header.q_dc_, a_dc = header.a_dc_;
+
+    // read the varying factors and boost saturation by 1.25x to compensate for quantization;
+    // lx and ly are at most 7, so every channel fits on the stack
+    int l_count = Channel::CountAC(lx, ly), pq_count = Channel::CountAC(3, 3);
+    float l_ac[7 * 7], p_ac[3 * 3], q_ac[3 * 3], a_ac[5 * 5];
+    if (!complete) {
+        fill(l_ac, l_ac + 7 * 7, 0.0f);
+        fill(p_ac, p_ac + 3 * 3, 0.0f);
+        fill(q_ac, q_ac + 3 * 3, 0.0f);
+        fill(a_ac, a_ac + 5 * 5, 0.0f);
+    } else {
+        const uint8_t* ac = &hash[header.ac_start_];
+        Channel::DequantizeNibbles(ac, 0, l_count, header.l_scale_, l_ac);
+        Channel::DequantizeNibbles(ac, l_count, pq_count, header.p_scale_ * 1.25f, p_ac);
+        Channel::DequantizeNibbles(ac, l_count + pq_count, pq_count, header.q_scale_ * 1.25f, q_ac);
+        if (has_alpha)
+            Channel::DequantizeNibbles(ac, l_count + 2 * pq_count, Channel::CountAC(5, 5), header.a_scale_, a_ac);
+    }
+
+    // decode to RGB using the DCT; every pixel is overwritten, so a reused buffer needs no clearing
+    image.width_    = width;
+    image.height_   = height;
+    image.image_data_.resize(width * height);
+    vector<RGBAPixel>& image_data = image.image_data_;
     int cx_stop = max(lx, has_alpha ? 5 : 3);
     int cy_stop = max(ly, has_alpha ? 5 : 3);
-    vector<float> fx(cx_stop);
-    vector<float> fy(cy_stop);
+    float fx[7];
+    float fy[7];
     for (unsigned int y = 0; y < height; y++) {
         for (unsigned int x = 0; x < width; x++) {
             float l = l_dc, p = p_dc, q = q_dc, a = a_dc;
@@ -187,46 +720,142 @@ Image ThumbHash::ThumbHashToRGBA(vector<uint8_t> hash) {
             float b = l - 2.0f / 3.0f * p;
             float r = (3.0f * l - b + q) / 2.0f;
             float g = r - q;
-            image_data[x + y * width].red_      = (unsigned char) max(0.0f, round(255.0f * min(1.0f, r)));
-            image_data[x + y * width].green_    = (unsigned char) max(0.0f, round(255.0f * min(1.0f, g)));
-            image_data[x + y * width].blue_     = (unsigned char) max(0.0f, round(255.0f * min(1.0f, b)));
+            if (thresholds) {
+                image_data[x + y * width].red_      = ToSRGB(r, thresholds);
+                image_data[x + y * width].green_    = ToSRGB(g, thresholds);
+                image_data[x + y * width].blue_     = ToSRGB(b, thresholds);
+            } else {
+                image_data[x + y * width].red_      = (unsigned char) max(0.0f, round(255.0f * min(1.0f, r)));
+                image_data[x + y * width].green_    = (unsigned char) max(0.0f, round(255.0f * min(1.0f, g)));
+                image_data[x + y * width].blue_     = (unsigned char) max(0.0f, round(255.0f * min(1.0f, b)));
+            }
             image_data[x + y * width].alpha_    = (unsigned char) max(0.0f, round(255.0f * min(1.0f, a)));
         }
     }
-    delete l_channel;
-    delete p_channel;
-    delete q_channel;
-    delete a_channel;
-    
-    return Image(width, height, image_data);
-}
-
-RGBAPixel ThumbHash::ThumbHashToAverageRGBA(vector<uint8_t> hash) {
-    int header = (hash[0] & 255) | ((hash[1] & 255) << 8) | ((hash[2] & 255) << 16);
-    float l = (float) (header & 63) / 63.0f;
-    float p = (float) ((header >> 6) & 63) / 31.5f - 1.0f;
-    float q = (float) ((header >> 12) & 63) / 31.5f - 1.0f;
-    bool has_alpha = (header >> 23) != 0;
-    float a = has_alpha ? (float) (hash[5] & 15) / 15.0f : 1.0f;
+}
+
+RGBAPixel ThumbHash::ThumbHashToAverageRGBA(vector<uint8_t> const & hash) {
+    return ThumbHashToAverageRGBA(hash, false);
+}
+
+RGBAPixel ThumbHash::ThumbHashToAverageRGBA(vector<uint8_t> const & hash, bool linear_light) {
+    ThumbHashHeader header;
+    header.Parse(hash.data(), hash.size());
+    float l = header.l_dc_, p = header.p_dc_, q = header.q_dc_, a = header.a_dc_;
     float b = l - 2.0f / 3.0f * p;
     float r = (3.0f * l - b + q) / 2.0f;
     float g = r - q;
+    if (linear_light)
+        return RGBAPixel(LinearToSRGB(r), LinearToSRGB(g), LinearToSRGB(b),
+                (unsigned char) round(255.0f * a));
     return RGBAPixel(
-        max(0.0f, min(1.0f, r)), 
-        max(0.0f, min(1.0f, g)), 
-        max(0.0f, min(1.0f, b)), 
-        a);
-}
-
-double ThumbHash::ThumbHashToApproximateAspectRatio(vector<uint8_t> hash) {
-    uint8_t header = hash[3];
-    bool has_alpha = (hash[2] & 0x80) != 0;
-    bool is_landscape = (hash[4] & 0x80) != 0;
-    int lx = is_landscape ? has_alpha ? 5 : 7 : header & 7;
-    int ly = is_landscape ? header & 7 : has_alpha ? 5 : 7;
+        (unsigned char) round(255.0f * max(0.0f, min(1.0f, r))), 
+        (unsigned char) round(255.0f * max(0.0f, min(1.0f, g))), 
+        (unsigned char) round(255.0f * max(0.0f, min(1.0f, b))), 
+        (unsigned char) round(255.0f * a));
+}
+
+double ThumbHash::ThumbHashToApproximateAspectRatio(vector<uint8_t> const & hash) {
+    ThumbHashHeader header;
+    if (!header.Parse(hash.data(), hash.size()))
+        return 1.0;
+    // the ratio uses the recorded order, not the decoder's minimum of 3
+    int lx = header.is_landscape_ ? header.has_alpha_ ? 5 : 7 : header.order_;
+    int ly = header.is_landscape_ ? header.order_ : header.has_alpha_ ? 5 : 7;
     return (float) lx / (float) ly;
 }
 
+unsigned char ThumbHash::LinearToSRGB(float value) {
+    return ToSRGB(value, LinearToSRGBThresholds());
+}
+
+bool ThumbHash::IsValidThumbHash(vector<uint8_t> const & hash) {
+    return IsValidThumbHash(hash.data(), hash.size());
+}
+
+bool ThumbHash::IsValidThumbHash(const uint8_t* hash, size_t size) {
+    ThumbHashHeader header;
+    return header.Parse(hash, size) && size >= header.HashSize();
+}
+
+// evaluates the low-frequency (cx + cy <= 2) terms of a decoded channel at (x, y) in [0, 1]
+static float EvaluateLowFrequency(Channel *channel, float dc, float x, float y) {
+    float value = dc;
+    for (int cy = 0, j = 0; cy < channel->ny_; cy++) {
+        float fy2 = (float) cos(M_PI * y * cy) * 2.0f;
+        for (int cx = cy > 0 ? 0 : 1; cx * channel->ny_ < channel->nx_ * (channel->ny_ - cy); cx++, j++)
+            if (cx + cy <= 2)
+                value += channel->ac_[j] * (float) cos(M_PI * x * cx) * fy2;
+    }
+    return value;
+}
+
+string ThumbHash::ThumbHashToCSSGradient(vector<uint8_t> const & hash, int rows, int columns) {
+    return ThumbHashToCSSGradient(hash, rows, columns, false);
+}
+
+string ThumbHash::ThumbHashToCSSGradient(vector<uint8_t> const & hash, int rows, int columns,
+        bool linear_light) {
+    ThumbHashHeader header;
+    if (rows < 1 || columns < 2 || !header.Parse(hash.data(), hash.size()) || hash.size() < header.HashSize())
+        return string();
+    bool has_alpha = header.has_alpha_;
+    float l_dc = header.l_dc_, p_dc = header.p_dc_, q_dc = header.q_dc_, a_dc = header.a_dc_;
+
+    // only the AC terms are decoded, the pixels are never rendered
+    Channel l_channel(header.lx_, header.ly_), p_channel(3, 3), q_channel(3, 3), a_channel(5, 5);
+    int ac_index = 0;
+    ac_index = l_channel.Decode(hash, header.ac_start_, ac_index, header.l_scale_);
+    ac_index = p_channel.Decode(hash, header.ac_start_, ac_index, header.p_scale_ * 1.25f);
+    ac_index = q_channel.Decode(hash, header.ac_start_, ac_index, header.q_scale_ * 1.25f);
+    if (has_alpha) a_channel.Decode(hash, header.ac_start_, ac_index, header.a_scale_);
+
+    RGBAPixel average = ThumbHashToAverageRGBA(hash, linear_light);
+    const float* thresholds = linear_light ? LinearToSRGBThresholds() : nullptr;
+    ostringstream css;
+    // with alpha the background must stay as transparent as the average, or clear areas turn solid
+    if (has_alpha)
+        css << "background-color: rgba(" << (int) average.red_ << ", " << (int) average.green_
+                << ", " << (int) average.blue_ << ", " << round(100.0 * average.alpha_ / 255.0) / 100.0 << ");";
+    else
+        css << "background-color: rgb(" << (int) average.red_ << ", " << (int) average.green_
+                << ", " << (int) average.blue_ << ");";
+
+    // sample each band along its centre line and emit one gradient per band
+    css << " background-image: ";
+    for (int row = 0; row < rows; row++) {
+        float y = (row + 0.5f) / rows;
+        css << (row > 0 ? ", " : "") << "linear-gradient(to right";
+        for (int column = 0; column < columns; column++) {
+            float x = (float) column / (columns - 1);
+            float l = EvaluateLowFrequency(&l_channel, l_dc, x, y);
+            float p = EvaluateLowFrequency(&p_channel, p_dc, x, y);
+            float q = EvaluateLowFrequency(&q_channel, q_dc, x, y);
+            float a = has_alpha ? EvaluateLowFrequency(&a_channel, a_dc, x, y) : 1.0f;
+
+            // convert to RGB
+            float b = l - 2.0f / 3.0f * p;
+            float r = (3.0f * l - b + q) / 2.0f;
+            float g = r - q;
+            if (thresholds)
+                css << ", rgba(" << (int) ToSRGB(r, thresholds) << ", " << (int) ToSRGB(g, thresholds)
+                        << ", " << (int) ToSRGB(b, thresholds);
+            else
+                css << ", rgba(" << (int) max(0.0f, round(255.0f * min(1.0f, r)))
+                        << ", " << (int) max(0.0f, round(255.0f * min(1.0f, g)))
+                        << ", " << (int) max(0.0f, round(255.0f * min(1.0f, b)));
+            css << ", " << max(0.0f, round(100.0f * min(1.0f, a))) / 100.0f
+                    << ") " << 100.0f * x << "%";
+        }
+        css << ")";
+    }
+    css << "; background-position: ";
+    for (int row = 0; row < rows; row++)
+        css << (row > 0 ? ", " : "") << "0 " << (rows > 1 ? 100.0f * row / (rows - 1) : 0.0f) << "%";
+    css << "; background-size: 100% " << 100.0f / rows << "%; background-repeat: no-repeat;";
+    return css.str();
+}
+
 
 Image::Image() {
     width_      = 0;
@@ -239,14 +868,126 @@ Image::Image(unsigned int width, unsigned int height, vector<RGBAPixel> image_da
     image_data_ = image_data;
 }
 
+Image Image::Downscale(unsigned int max_edge) const {
+    unsigned int edge = max(width_, height_);
+    if (edge <= max_edge)
+        return *this;
+    unsigned int width = max(1u, (unsigned int) (((uint64_t) width_ * max_edge + edge / 2) / edge));
+    unsigned int height = max(1u, (unsigned int) (((uint64_t) height_ * max_edge + edge / 2) / edge));
+
+    // sum every source pixel into the target pixel it falls in, colour premultiplied by alpha
+    vector<double> sums(width * height * 4, 0.0);
+    vector<unsigned int> counts(width * height, 0);
+    for (unsigned int y = 0; y < height_; y++) {
+        unsigned int row = (unsigned int) ((uint64_t) y * height / height_) * width;
+        for (unsigned int x = 0; x < width_; x++) {
+            unsigned int target = row + (unsigned int) ((uint64_t) x * width / width_);
+            RGBAPixel const & pixel = image_data_[x + y * width_];
+            double* sum = &sums[target * 4];
+            sum[0] += pixel.red_ * pixel.alpha_;
+            sum[1] += pixel.green_ * pixel.alpha_;
+            sum[2] += pixel.blue_ * pixel.alpha_;
+            sum[3] += pixel.alpha_;
+            counts[target]++;
+        }
+    }
+
+    Image image;
+    image.width_    = width;
+    image.height_   = height;
+    image.image_data_.resize(width * height);
+    for (unsigned int i = 0; i < width * height; i++) {
+        double* sum = &sums[i * 4];
+        double alpha = sum[3] / max(1u, counts[i]);
+        if (sum[3] > 0)
+            image.image_data_[i] = RGBAPixel((unsigned char) round(sum[0] / sum[3]),
+                    (unsigned char) round(sum[1] / sum[3]), (unsigned char) round(sum[2] / sum[3]),
+                    (unsigned char) round(alpha));
+        else
+            image.image_data_[i] = RGBAPixel(0, 0, 0, 0);
+    }
+    return image;
+}
+
+ImageStatus::ImageStatus() {
+    error_  = ImageError::kNone;
+    code_   = 0;
+}
+
+ImageStatus::ImageStatus(ImageError error, unsigned int code) {
+    error_  = error;
+    code_   = code;
+}
+
+bool ImageStatus::Ok() const {
+    return error_ == ImageError::kNone;
+}
+
+string ImageStatus::Message() const {
+    if (Ok())
+        return "";
+    if (error_ == ImageError::kEmpty)
+        return "image error: the image has no pixels";
+    bool writing = error_ == ImageError::kEncode || error_ == ImageError::kFileWrite;
+    return (writing ? "PNG encoding error " : "PNG decoder error ") + to_string(code_) + ": "
+            + lodepng_error_text(code_);
+}
+
+// the bool-only overloads keep reporting failures on cerr
+static bool Report(ImageStatus const & status) {
+    if (!status.Ok())
+        cerr << status.Message() << endl;
+    return status.Ok();
+}
+
+// loads a whole file, counting it as the file read stage
+static ImageStatus LoadFile(vector<unsigned char>& png, string const & fileName) {
+    THUMBHASH_TIMER(timer, Stage::kFileRead);
+    unsigned error = lodepng::load_file(png, fileName);
+    THUMBHASH_COUNT(Counter::kBytesRead, png.size());
+    return error ? ImageStatus(ImageError::kFileRead, error) : ImageStatus();
+}
+
+// packs RGBAPixels into the RGBA8 bytes lodepng encodes
+static vector<unsigned char> PackRGBA(Image const & image) {
+    vector<unsigned char> byte_data(image.width_ * image.height_ * 4);
+    for (unsigned i = 0; i < image.width_ * image.height_; i++) {
+        byte_data[(i * 4)]     = image.image_data_[i].red_;
+        byte_data[(i * 4) + 1] = image.image_data_[i].green_;
+        byte_data[(i * 4) + 2] = image.image_data_[i].blue_;
+        byte_data[(i * 4) + 3] = image.image_data_[i].alpha_;
+    }
+    return byte_data;
+}
+
 bool Image::ReadFromFile(string const & fileName) {
+    ImageStatus status;
+    ReadFromFile(fileName, status);
+    return Report(status);
+}
+
+bool Image::ReadFromFile(string const & fileName, ImageStatus& status) {
+    vector<unsigned char> png;
+    status = LoadFile(png, fileName);
+    return status.Ok() && ReadFromMemory(png, status);
+}
+
+bool Image::ReadFromMemory(vector<unsigned char> const & png) {
+    ImageStatus status;
+    ReadFromMemory(png, status);
+    return Report(status);
+}
+
+bool Image::ReadFromMemory(vector<unsigned char> const & png, ImageStatus& status) {
+    THUMBHASH_TIMER(timer, Stage::kInflate);
     vector<unsigned char> byte_data;
-    unsigned error = lodepng::decode(byte_data, width_, height_, fileName);
+    unsigned error = lodepng::decode(byte_data, width_, height_, png);
     if (error) {
-      cerr << "PNG decoder error " << error << ": " << lodepng_error_text(error) << endl;
-      return false;
+        status = ImageStatus(ImageError::kDecode, error);
+        return false;
     }
 
+    THUMBHASH_NEXT_STAGE(timer, Stage::kRepack);
     image_data_ = vector<RGBAPixel>(width_ * height_);
     for (unsigned i = 0; i < byte_data.size(); i += 4) {
         RGBAPixel &pixel = image_data_[i/4];
@@ -255,23 +996,146 @@ bool Image::ReadFromFile(string const & fileName) {
         pixel.blue_     = byte_data[i + 2];
         pixel.alpha_    = byte_data[i + 3];
     }
+    status = ImageStatus();
     return true;
 }
 
-bool Image::WriteToFile(string const & fileName) {
-    vector<unsigned char> byte_data(width_ * height_ * 4);
-    for (unsigned i = 0; i < width_ * height_; i++) {
-        byte_data[(i * 4)]     = image_data_[i].red_;
-        byte_data[(i * 4) + 1] = image_data_[i].green_;
-        byte_data[(i * 4) + 2] = image_data_[i].blue_;
-        byte_data[(i * 4) + 3] = image_data_[i].alpha_;
-    }
+bool Image::WriteToFile(string const & fileName) const {
+    ImageStatus status;
+    WriteToFile(fileName, status);
+    return Report(status);
+}
+
+bool Image::WriteToFile(string const & fileName, ImageStatus& status) const {
+    vector<unsigned char> png;
+    if (!WriteToMemory(png, status))
+        return false;
+    unsigned error = lodepng::save_file(png, fileName);
+    status = error ? ImageStatus(ImageError::kFileWrite, error) : ImageStatus();
+    return status.Ok();
+}
+
+bool Image::WriteToMemory(vector<unsigned char>& png) const {
+    ImageStatus status;
+    WriteToMemory(png, status);
+    return Report(status);
+}
 
-    unsigned error = lodepng::encode(fileName, byte_data, width_, height_);
+bool Image::WriteToMemory(vector<unsigned char>& png, ImageStatus& status) const {
+    png.clear();
+    unsigned error = lodepng::encode(png, PackRGBA(*this), width_, height_);
+    status = error ? ImageStatus(ImageError::kEncode, error) : ImageStatus();
+    return status.Ok();
+}
+
+// decodes a palette PNG into a kPalette8 image: one index byte per pixel and the RGBA8 palette
+static ImageStatus ReadPalette(PixelImage& image, vector<unsigned char> const & png, lodepng::State& state) {
+    // take the indices as stored, then widen packed 1, 2 or 4-bit indices to a byte each;
+    // lodepng leaves no padding bits between rows
+    state.decoder.color_convert = 0;
+    vector<unsigned char> packed;
+    unsigned error = lodepng::decode(packed, image.width_, image.height_, state, png);
     if (error)
-        cerr << "PNG encoding error " << error << ": " << lodepng_error_text(error) << endl;
+        return ImageStatus(ImageError::kDecode, error);
+    LodePNGColorMode const & color = state.info_png.color;
+    unsigned int bits = color.bitdepth;
+    image.format_ = PixelFormat::kPalette8;
+    if (bits == 8) {
+        image.data_.swap(packed);
+    } else {
+        image.data_ = vector<unsigned char>(image.width_ * image.height_);
+        for (size_t i = 0; i < image.data_.size(); i++) {
+            size_t bit = i * bits;
+            image.data_[i] = (packed[bit / 8] >> (8 - bits - bit % 8)) & ((1 << bits) - 1);
+        }
+    }
+
+    // entries past the end of the palette read as opaque black
+    image.palette_ = vector<unsigned char>(256 * 4, 0);
+    for (int e = 0; e < 256; e++)
+        image.palette_[e * 4 + 3] = 255;
+    copy(color.palette, color.palette + color.palettesize * 4, image.palette_.begin());
+    return ImageStatus();
+}
+
+PixelImage::PixelImage() {
+    width_      = 0;
+    height_     = 0;
+    format_     = PixelFormat::kRGBA8;
+}
 
-    return (error == 0);
+bool PixelImage::ReadFromFile(string const & fileName) {
+    ImageStatus status;
+    ReadFromFile(fileName, status);
+    return Report(status);
+}
+
+bool PixelImage::ReadFromFile(string const & fileName, ImageStatus& status) {
+    vector<unsigned char> png;
+    status = LoadFile(png, fileName);
+    return status.Ok() && ReadFromMemory(png, status);
+}
+
+bool PixelImage::ReadFromMemory(vector<unsigned char> const & png) {
+    ImageStatus status;
+    ReadFromMemory(png, status);
+    return Report(status);
+}
+
+bool PixelImage::ReadFromMemory(vector<unsigned char> const & png, ImageStatus& status) {
+    THUMBHASH_TIMER(timer, Stage::kInflate);
+    lodepng::State state;
+    unsigned error = lodepng_inspect(&width_, &height_, &state, png.data(), png.size());
+    if (error) {
+        status = ImageStatus(ImageError::kDecode, error);
+        return false;
+    }
+
+    // pick the layout closest to the file's own, so lodepng only unfilters and copies
+    LodePNGColorMode const & color = state.info_png.color;
+    bool wide = color.bitdepth == 16;
+    LodePNGColorType type = LCT_RGBA;
+    switch (color.colortype) {
+        case LCT_GREY:
+            type    = color.key_defined ? LCT_GREY_ALPHA : LCT_GREY;
+            format_ = color.key_defined ? (wide ? PixelFormat::kGreyAlpha16 : PixelFormat::kGreyAlpha8)
+                    : (wide ? PixelFormat::kGrey16 : PixelFormat::kGrey8);
+            break;
+        case LCT_GREY_ALPHA:
+            type    = LCT_GREY_ALPHA;
+            format_ = wide ? PixelFormat::kGreyAlpha16 : PixelFormat::kGreyAlpha8;
+            break;
+        case LCT_RGB:
+            type    = color.key_defined ? LCT_RGBA : LCT_RGB;
+            format_ = color.key_defined ? (wide ? PixelFormat::kRGBA16 : PixelFormat::kRGBA8)
+                    : (wide ? PixelFormat::kRGB16 : PixelFormat::kRGB8);
+            break;
+        case LCT_RGBA:
+            format_ = wide ? PixelFormat::kRGBA16 : PixelFormat::kRGBA8;
+            break;
+        default:
+            status = ReadPalette(*this, png, state);
+            return status.Ok();
+    }
+
+    error = lodepng::decode(data_, width_, height_, png, type, wide ? 16 : 8);
+    status = error ? ImageStatus(ImageError::kDecode, error) : ImageStatus();
+    return status.Ok();
+}
+
+unsigned int PixelImage::BytesPerPixel() const {
+    switch (format_) {
+        case PixelFormat::kGrey8:       return 1;
+        case PixelFormat::kGrey16:      return 2;
+        case PixelFormat::kGreyAlpha8:  return 2;
+        case PixelFormat::kGreyAlpha16: return 4;
+        case PixelFormat::kRGB8:        return 3;
+        case PixelFormat::kRGB16:       return 6;
+        case PixelFormat::kRGBA8:       return 4;
+        case PixelFormat::kRGBA16:      return 8;
+        case PixelFormat::kPalette8:    return 1;
+    }
+    return 4;
 }
 
 RGBAPixel::RGBAPixel() {
@@ -288,19 +1152,44 @@ RGBAPixel::RGBAPixel(unsigned char red, unsigned char green, unsigned char blue,
     alpha_  = alpha;
 }
 
+ThumbHashScratch::ThumbHashScratch() {
+}
+
+Channel::Channel() {
+    nx_ = 0;
+    ny_ = 0;
+    dc_ = 0;
+    scale_ = 0;
+}
+
 Channel::Channel(int nx, int ny) {
+    Reset(nx, ny);
+}
+
+void Channel::Reset(int nx, int ny) {
     nx_ = nx;
     ny_ = ny;
+    dc_ = 0;
+    scale_ = 0;
+    ac_.assign(CountAC(nx, ny), 0.0f);
+}
+
+int Channel::CountAC(int nx, int ny) {
     int n = 0;
-    for (int cy = 0; cy < ny; cy++) 
+    for (int cy = 0; cy < ny; cy++)
         for (int cx = cy > 0 ? 0 : 1; cx * ny < nx * (ny - cy); cx++)
             n++;
-    ac_ = vector<float>(n);
+    return n;
+}
+
+Channel* Channel::Encode(int width, int height, vector<float> const & channel) {
+    vector<float> fx;
+    return Encode(width, height, channel, fx);
 }
 
-Channel* Channel::Encode(int width, int height, vector<float> channel) {
+Channel* Channel::Encode(int width, int height, vector<float> const & channel, vector<float>& fx) {
     int n = 0;
-    vector<float> fx(width);
+    fx.resize(width);
     for (int cy = 0; cy < ny_; cy++) {
         for (int cx = 0; cx * ny_ < nx_ * (ny_ - cy); cx++) {
             float f = 0;
@@ -328,20 +1217,187 @@ Channel* Channel::Encode(int width, int height, vector<float> channel) {
     return this;
 }
 
-int Channel::Decode(vector<uint8_t> hash, int start, int index, float scale) {
-    for (unsigned int i = 0; i < ac_.size(); i++) {
-        int data = hash[start + (index >> 1)] >> ((index & 1) << 2);
-        ac_[i] = ((float) (data & 15) / 7.5f - 1.0f) * scale;
-        index++;
+int Channel::Decode(vector<uint8_t> const & hash, int start, int index, float scale) {
+    if (!ac_.empty())
+        DequantizeNibbles(&hash[start], index, ac_.size(), scale, &ac_[0]);
+    return index + ac_.size();
+}
+
+#ifdef THUMBHASH_SSSE3_DISPATCH
+// true if pshufb can be used: always in builds that target it, otherwise if this CPU has it
+static bool HasSSSE3() {
+#ifdef __SSSE3__
+    return true;
+#else
+    static const bool supported = (__builtin_cpu_init(), __builtin_cpu_supports("ssse3") != 0);
+    return supported;
+#endif
+}
+
+// dequantizes runs of eight nibbles from a byte boundary by looking each one up in the scaled
+// table with pshufb, one byte plane of the floats at a time, so no float arithmetic is done
+// and the results are exactly the table's; returns the index of the first nibble left over
+__attribute__((target("ssse3")))
+static int DequantizeNibblesSSSE3(const uint8_t* bytes, int first, int i, int count, const float* table,
+        float* out) {
+    // gather byte k of every table entry into plane k: each 4-entry register is grouped
+    // by byte, then the 4x4 block of 32-bit groups is transposed
+    const __m128i by_byte = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    __m128i t0 = _mm_shuffle_epi8(_mm_castps_si128(_mm_loadu_ps(table)), by_byte);
+    __m128i t1 = _mm_shuffle_epi8(_mm_castps_si128(_mm_loadu_ps(table + 4)), by_byte);
+    __m128i t2 = _mm_shuffle_epi8(_mm_castps_si128(_mm_loadu_ps(table + 8)), by_byte);
+    __m128i t3 = _mm_shuffle_epi8(_mm_castps_si128(_mm_loadu_ps(table + 12)), by_byte);
+    __m128i low01 = _mm_unpacklo_epi32(t0, t1), low23 = _mm_unpacklo_epi32(t2, t3);
+    __m128i high01 = _mm_unpackhi_epi32(t0, t1), high23 = _mm_unpackhi_epi32(t2, t3);
+    const __m128i plane0 = _mm_unpacklo_epi64(low01, low23), plane1 = _mm_unpackhi_epi64(low01, low23);
+    const __m128i plane2 = _mm_unpacklo_epi64(high01, high23), plane3 = _mm_unpackhi_epi64(high01, high23);
+
+    const __m128i mask = _mm_set1_epi8(15);
+    for (; i + 16 <= count; i += 16) {
+        __m128i packed = _mm_loadl_epi64((const __m128i*) (bytes + ((first + i) >> 1)));
+        __m128i nibbles = _mm_unpacklo_epi8(_mm_and_si128(packed, mask),
+                _mm_and_si128(_mm_srli_epi16(packed, 4), mask)); // 16 x 8-bit, in order
+        __m128i b0 = _mm_shuffle_epi8(plane0, nibbles), b1 = _mm_shuffle_epi8(plane1, nibbles);
+        __m128i b2 = _mm_shuffle_epi8(plane2, nibbles), b3 = _mm_shuffle_epi8(plane3, nibbles);
+        __m128i low_bytes01 = _mm_unpacklo_epi8(b0, b1), low_bytes23 = _mm_unpacklo_epi8(b2, b3);
+        __m128i high_bytes01 = _mm_unpackhi_epi8(b0, b1), high_bytes23 = _mm_unpackhi_epi8(b2, b3);
+        _mm_storeu_si128((__m128i*) (out + i), _mm_unpacklo_epi16(low_bytes01, low_bytes23));
+        _mm_storeu_si128((__m128i*) (out + i + 4), _mm_unpackhi_epi16(low_bytes01, low_bytes23));
+        _mm_storeu_si128((__m128i*) (out + i + 8), _mm_unpacklo_epi16(high_bytes01, high_bytes23));
+        _mm_storeu_si128((__m128i*) (out + i + 12), _mm_unpackhi_epi16(high_bytes01, high_bytes23));
+    }
+    if (i + 8 <= count) {
+        int32_t word;
+        memcpy(&word, bytes + ((first + i) >> 1), sizeof(word));
+        __m128i packed = _mm_cvtsi32_si128(word);
+        __m128i nibbles = _mm_unpacklo_epi8(_mm_and_si128(packed, mask),
+                _mm_and_si128(_mm_srli_epi16(packed, 4), mask));
+        __m128i low_bytes01 = _mm_unpacklo_epi8(_mm_shuffle_epi8(plane0, nibbles), _mm_shuffle_epi8(plane1, nibbles));
+        __m128i low_bytes23 = _mm_unpacklo_epi8(_mm_shuffle_epi8(plane2, nibbles), _mm_shuffle_epi8(plane3, nibbles));
+        _mm_storeu_si128((__m128i*) (out + i), _mm_unpacklo_epi16(low_bytes01, low_bytes23));
+        _mm_storeu_si128((__m128i*) (out + i + 4), _mm_unpackhi_epi16(low_bytes01, low_bytes23));
+        i += 8;
+    }
+    return i;
+}
+#endif
+
+void Channel::DequantizeNibbles(const uint8_t* bytes, int first, int count, float scale, float* out) {
+    float table[16];
+    for (int value = 0; value < 16; value++)
+        table[value] = ((float) value / 7.5f - 1.0f) * scale;
+
+    int i = 0;
+    if ((first & 1) && count > 0) { // start on a byte boundary
+        out[0] = table[bytes[first >> 1] >> 4];
+        i = 1;
+    }
+#ifdef THUMBHASH_SSSE3_DISPATCH
+    if (HasSSSE3())
+        i = DequantizeNibblesSSSE3(bytes, first, i, count, table, out);
+#endif
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi8(15), zero = _mm_setzero_si128();
+    const __m128 divisor = _mm_set1_ps(7.5f), one = _mm_set1_ps(1.0f), scales = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        int32_t word;
+        memcpy(&word, bytes + ((first + i) >> 1), sizeof(word));
+        __m128i packed = _mm_cvtsi32_si128(word);
+        __m128i low = _mm_and_si128(packed, mask);
+        __m128i high = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+        __m128i nibbles = _mm_unpacklo_epi8(_mm_unpacklo_epi8(low, high), zero); // 8 x 16-bit, in order
+        __m128 first_half = _mm_cvtepi32_ps(_mm_unpacklo_epi16(nibbles, zero));
+        __m128 second_half = _mm_cvtepi32_ps(_mm_unpackhi_epi16(nibbles, zero));
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_sub_ps(_mm_div_ps(first_half, divisor), one), scales));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_sub_ps(_mm_div_ps(second_half, divisor), one), scales));
+    }
+#endif
+    for (; i < count; i++) {
+        int nibble = first + i;
+        out[i] = table[(bytes[nibble >> 1] >> ((nibble & 1) << 2)) & 15];
     }
-    return index;
 }
 
-int Channel::Write(vector<uint8_t>& hash, int start, int index) {
-    for (unsigned int i = 0; i < ac_.size(); i++) {
-        float val = ac_[i];
-        hash[start + (index >> 1)] |= ((int) round(15.0f * val)) << ((index & 1) << 2);
-        index++;
-    } 
-    return index;
-}
\ No newline at end of file
+void Channel::QuantizeNibbles(const float* values, int count, uint8_t* out) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128 fifteen = _mm_set1_ps(15.0f), zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f);
+    const __m128i low_byte = _mm_set1_epi16(255);
+    for (; i + 8 <= count; i += 8) {
+        // round half away from zero exactly: truncate, then add 1 if the exact fraction is >= 0.5
+        __m128 first = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(values + i), fifteen), zero), fifteen);
+        __m128 second = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(values + i + 4), fifteen), zero), fifteen);
+        __m128i first_int = _mm_cvttps_epi32(first), second_int = _mm_cvttps_epi32(second);
+        first_int = _mm_sub_epi32(first_int, _mm_castps_si128(
+                _mm_cmpge_ps(_mm_sub_ps(first, _mm_cvtepi32_ps(first_int)), half)));
+        second_int = _mm_sub_epi32(second_int, _mm_castps_si128(
+                _mm_cmpge_ps(_mm_sub_ps(second, _mm_cvtepi32_ps(second_int)), half)));
+
+        // each 16-bit lane holds a nibble pair as lo | hi << 8, which folds to lo | hi << 4
+        __m128i pairs = _mm_packus_epi16(_mm_packs_epi32(first_int, second_int), _mm_setzero_si128());
+        pairs = _mm_and_si128(_mm_or_si128(pairs, _mm_srli_epi16(pairs, 4)), low_byte);
+        int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(pairs, _mm_setzero_si128()));
+        memcpy(out + i / 2, &packed, sizeof(packed));
+    }
+#endif
+    for (; i < count; i++) {
+        int nibble = (int) round(max(0.0f, min(15.0f, 15.0f * values[i])));
+        if (i & 1)
+            out[i >> 1] |= nibble << 4;
+        else
+            out[i >> 1] = nibble;
+    }
+}
+ThumbHashHeader::ThumbHashHeader() {
+    l_code_         = 0;
+    p_code_         = 0;
+    q_code_         = 0;
+    order_          = 0;
+    l_dc_           = 0;
+    p_dc_           = 0;
+    q_dc_           = 0;
+    a_dc_           = 1.0f;
+    l_scale_        = 0;
+    p_scale_        = 0;
+    q_scale_        = 0;
+    a_scale_        = 0;
+    has_alpha_      = false;
+    is_landscape_   = false;
+    lx_             = 3;
+    ly_             = 3;
+    ac_start_       = 5;
+    ac_count_       = 0;
+}
+
+bool ThumbHashHeader::Parse(const uint8_t* hash, size_t size) {
+    if (size < 5)
+        return false;
+    int header24 = (hash[0] & 255) | ((hash[1] & 255) << 8) | ((hash[2] & 255) << 16);
+    int header16 = (hash[3] & 255) | ((hash[4] & 255) << 8);
+    has_alpha_ = (header24 >> 23) != 0;
+    if (has_alpha_ && size < 6)
+        return false;
+    l_code_ = header24 & 63;
+    p_code_ = (header24 >> 6) & 63;
+    q_code_ = (header24 >> 12) & 63;
+    order_ = header16 & 7;
+    l_dc_ = (float) l_code_ / 63.0f;
+    p_dc_ = (float) p_code_ / 31.5f - 1.0f;
+    q_dc_ = (float) q_code_ / 31.5f - 1.0f;
+    a_dc_ = has_alpha_ ? (float) (hash[5] & 15) / 15.0f : 1.0f;
+    l_scale_ = (float) ((header24 >> 18) & 31) / 31.0f;
+    p_scale_ = (float) ((header16 >> 3) & 63) / 63.0f;
+    q_scale_ = (float) ((header16 >> 9) & 63) / 63.0f;
+    a_scale_ = has_alpha_ ? (float) ((hash[5] >> 4) & 15) / 15.0f : 0.0f;
+    is_landscape_ = (header16 >> 15) != 0;
+    lx_ = max(3, is_landscape_ ? has_alpha_ ? 5 : 7 : order_);
+    ly_ = max(3, is_landscape_ ? order_ : has_alpha_ ? 5 : 7);
+    ac_start_ = has_alpha_ ? 6 : 5;
+    ac_count_ = Channel::CountAC(lx_, ly_) + 2 * Channel::CountAC(3, 3)
+            + (has_alpha_ ? Channel::CountAC(5, 5) : 0);
+    return true;
+}
+
+size_t ThumbHashHeader::HashSize() const {
+    return ac_start_ + (ac_count_ + 1) / 2;
+}
@@ -30,6 +30,46 @@ class RGBAPixel {
        RGBAPixel(unsigned char red, unsigned char green, unsigned char blue, unsigned char alpha);
 };
 
+/* why reading or writing a PNG failed */
+enum class ImageError {
+    kNone,
+    kFileRead, /* the file could not be opened or read */
+    kFileWrite, /* the file could not be created or written */
+    kDecode, /* the bytes are not a PNG lodepng can decode */
+    kEncode, /* lodepng could not encode the pixels */
+    kEmpty /* the image has no pixels, so it cannot be hashed */
+};
+
+class ImageStatus {
+    public:
+        ImageError error_; /* what failed, or kNone */
+        unsigned int code_; /* the lodepng error code, or 0 */
+
+        /**
+         * Constructs a successful ImageStatus.
+        */
+        ImageStatus();
+
+        /**
+         * Constructs an ImageStatus for a failure.
+         * 
+         * @param error - what failed
+         * @param code - the lodepng error code
+        */
+        ImageStatus(ImageError error, unsigned int code);
+
+        /**
+         * @returns true, if nothing failed
+        */
+        bool Ok() const;
+
+        /**
+         * @returns a one-line description of the failure, such as "PNG decoder error 28: ...",
+         * or an empty string if nothing failed
+        */
+        string Message() const;
+};
+
 class Image {
     public:
         unsigned int width_; /* the width of the image */
@@ -60,48 +100,144 @@ class Image {
          */
         bool ReadFromFile(string const & fileName);
 
+        /**
+         * Reads in a PNG image from a file, reporting failure through status instead of cerr.
+         * 
+         * @param fileName - name of the file to be read from.
+         * @param status - receives the outcome
+         * @return true, if the image was successfully read and loaded.
+         */
+        bool ReadFromFile(string const & fileName, ImageStatus& status);
+
+        /**
+         * Reads in a PNG image from an in-memory buffer.
+         * Overwrites any current image content in the PNG.
+         * 
+         * @param png - the PNG file bytes.
+         * @return true, if the image was successfully decoded and loaded.
+         */
+        bool ReadFromMemory(vector<unsigned char> const & png);
+
+        /**
+         * Reads in a PNG image from an in-memory buffer, reporting failure through status
+         * instead of cerr.
+         * 
+         * @param png - the PNG file bytes.
+         * @param status - receives the outcome
+         * @return true, if the image was successfully decoded and loaded.
+         */
+        bool ReadFromMemory(vector<unsigned char> const & png, ImageStatus& status);
+
         /**
          * Writes a PNG image to a file.
          * 
          * @param fileName - name of the file to be written.
          * @return true, if the image was successfully written.
          */
-        bool WriteToFile(string const & fileName);
+        bool WriteToFile(string const & fileName) const;
+
+        /**
+         * Writes a PNG image to a file, reporting failure through status instead of cerr.
+         * 
+         * @param fileName - name of the file to be written.
+         * @param status - receives the outcome
+         * @return true, if the image was successfully written.
+         */
+        bool WriteToFile(string const & fileName, ImageStatus& status) const;
+
+        /**
+         * Encodes the image as a PNG into memory.
+         * 
+         * @param png - the buffer that receives the PNG bytes
+         * @return true, if the image was successfully encoded.
+         */
+        bool WriteToMemory(vector<unsigned char>& png) const;
+
+        /**
+         * Encodes the image as a PNG into memory, reporting failure through status instead of cerr.
+         * 
+         * @param png - the buffer that receives the PNG bytes
+         * @param status - receives the outcome
+         * @return true, if the image was successfully encoded.
+         */
+        bool WriteToMemory(vector<unsigned char>& png, ImageStatus& status) const;
+
+        /**
+         * Box-filters the image down so neither side exceeds max_edge, keeping the aspect ratio.
+         * Colour is averaged premultiplied by alpha, so transparent pixels do not tint the result.
+         * 
+         * @param max_edge - the longest side the result may have, at least 1
+         * @returns the downscaled image, or a copy if the image already fits
+        */
+        Image Downscale(unsigned int max_edge) const;
 };
 
-class ThumbHash {
+/* the sample layouts a PixelImage can hold; 16-bit samples are big-endian, as stored in PNG */
+enum class PixelFormat {
+    kGrey8, kGrey16,
+    kGreyAlpha8, kGreyAlpha16,
+    kRGB8, kRGB16,
+    kRGBA8, kRGBA16,
+    kPalette8
+};
+
+class PixelImage {
     public:
+        unsigned int width_; /* the width of the image */
+        unsigned int height_; /* the height of the image */
+        PixelFormat format_; /* the layout of each pixel in data_ */
+        vector<unsigned char> data_; /* the samples in the image, row by row */
+        vector<unsigned char> palette_; /* 256 RGBA8 entries, indexed by data_ in kPalette8 */
+
         /**
-         * Encodes an Image to a ThumbHash.
-         * 
-         * @param image - the image to be converted to a ThumbHash
-         * @returns the encoded unsigned 8-bit integer array
+         * Constructs a default PixelImage.
+         * The default width and height is 0, with no samples, in RGBA8.
         */
-        vector<uint8_t> RGBAToThumbHash(Image image);
+        PixelImage();
 
         /**
-         * Decodes a ThumbHash to an Image.
+         * Reads in a PNG image from a file, keeping its own channels and bit depth.
+         * Overwrites any current image content in the PixelImage.
          * 
-         * @param hash - the unsigned 8-bit integer array
-         * @returns the decoded image
-        */
-        Image ThumbHashToRGBA(vector<uint8_t> hash);
+         * @param fileName - name of the file to be read from.
+         * @return true, if the image was successfully read and loaded.
+         */
+        bool ReadFromFile(string const & fileName);
 
         /**
-         * Computes the average colour from a given thumbhash.
+         * Reads in a PNG image from a file, reporting failure through status instead of cerr.
          * 
-         * @param hash - the unsigned 8-bit integer array
-         * @returns the average rgba values
-        */
-        RGBAPixel ThumbHashToAverageRGBA(vector<uint8_t> hash);
+         * @param fileName - name of the file to be read from.
+         * @param status - receives the outcome
+         * @return true, if the image was successfully read and loaded.
+         */
+        bool ReadFromFile(string const & fileName, ImageStatus& status);
 
         /**
-         * Computes the approximate aspect ratio (width / height) from a given thumbhash.
+         * Decodes a PNG image from memory, keeping its own channels and bit depth.
+         * Grey, grey-alpha, RGB and RGBA images are decoded straight into the matching
+         * format with no RGBA8 conversion pass, and 16-bit images keep all 16 bits.
+         * Grey below 8 bits is widened to 8 bits, a transparent colour key adds an alpha
+         * channel, and palette images keep their palette with one index byte per pixel.
          * 
-         * @param hash - the unsigned 8-bit integer array
-         * @returns the approximate aspect ratio
+         * @param png - the PNG file bytes.
+         * @return true, if the image was successfully decoded and loaded.
+         */
+        bool ReadFromMemory(vector<unsigned char> const & png);
+
+        /**
+         * Decodes a PNG image from memory, reporting failure through status instead of cerr.
+         * 
+         * @param png - the PNG file bytes.
+         * @param status - receives the outcome
+         * @return true, if the image was successfully decoded and loaded.
+         */
+        bool ReadFromMemory(vector<unsigned char> const & png, ImageStatus& status);
+
+        /**
+         * @returns the number of bytes in each pixel of format_
         */
-        double ThumbHashToApproximateAspectRatio(vector<uint8_t> hash);
+        unsigned int BytesPerPixel() const;
 };
 
 class Channel {
@@ -112,6 +248,11 @@ class Channel {
         vector<float> ac_;
         float scale_;
 
+        /**
+         * Constructs an empty colour channel with no AC terms, to be Reset before use.
+        */
+        Channel();
+
         /**
          * Constructs a colour channel using the given nx and ny values
          * 
@@ -120,6 +261,25 @@ class Channel {
         */
         Channel(int nx, int ny);
 
+        /**
+         * Makes this a fresh nx by ny channel with every term at 0, keeping the capacity
+         * of ac_, so a reused channel allocates nothing once it has held as many terms.
+         * 
+         * @param nx - the x-component of the normalized AC (varying) terms
+         * @param ny - the y-component of the normalized AC (varying) terms
+        */
+        void Reset(int nx, int ny);
+
+        /**
+         * Counts the AC terms of an nx by ny channel, the terms with cx * ny < nx * (ny - cy)
+         * other than the DC term.
+         * 
+         * @param nx - the x-component of the normalized AC (varying) terms
+         * @param ny - the y-component of the normalized AC (varying) terms
+         * @returns the number of AC terms
+        */
+        static int CountAC(int nx, int ny);
+
         /**
          * Encodes the colour channel using the DCT into DC (constant) and AC (varying) terms
          * 
@@ -128,7 +288,18 @@ class Channel {
          * @param channel - the channel values for each pixel in the image
          * @returns the Channel object
         */
-        Channel* Encode(int width, int height, vector<float> channel);
+        Channel* Encode(int width, int height, vector<float> const & channel);
+
+        /**
+         * Encodes the colour channel like Encode, keeping its row of cosines in fx.
+         * 
+         * @param width - the width of the image
+         * @param height - the height of the image
+         * @param channel - the channel values for each pixel in the image
+         * @param fx - working space for the row of cosines, grown to width
+         * @returns the Channel object
+        */
+        Channel* Encode(int width, int height, vector<float> const & channel, vector<float>& fx);
 
         /**
          * Decodes the varying terms and returns the index
@@ -139,17 +310,349 @@ class Channel {
          * @param scale - the scale for the decoded values
          * @returns the current index in the decoder
         */
-        int Decode(vector<uint8_t> hash, int start, int index, float scale);
+        int Decode(vector<uint8_t> const & hash, int start, int index, float scale);
+
+        /**
+         * Dequantizes a run of packed 4-bit AC values, low nibble first, in one pass:
+         * out[i] = (nibble(first + i) / 7.5 - 1) * scale. On CPUs with SSSE3, checked at
+         * runtime unless the build targets it, runs of sixteen nibbles are looked up in the
+         * scaled 16-entry table with pshufb; otherwise runs of eight are converted with SSE2.
+         * The rest go through the table directly. Every path rounds exactly like the scalar formula.
+         * 
+         * @param bytes - the packed AC bytes
+         * @param first - the index of the first nibble to read
+         * @param count - the number of nibbles to read
+         * @param scale - the scale for the decoded values
+         * @param out - receives count dequantized values
+        */
+        static void DequantizeNibbles(const uint8_t* bytes, int first, int count, float scale, float* out);
 
         /**
-         * Writes the encoded varying terms into the array and returns the index
+         * Quantizes normalized AC values in [0, 1] to 4 bits and packs them pairwise,
+         * low nibble first, in one pass. Runs of eight values use SSE2; both paths round
+         * exactly like round(15 * value).
          * 
+         * @param values - the normalized AC values of every channel, back to back
+         * @param count - the number of values
+         * @param out - receives (count + 1) / 2 bytes
+        */
+        static void QuantizeNibbles(const float* values, int count, uint8_t* out);
+};
+
+class ThumbHashHeader {
+    public:
+        int l_code_; /* the quantized 6-bit luminance DC */
+        int p_code_; /* the quantized 6-bit yellow - blue DC */
+        int q_code_; /* the quantized 6-bit red - green DC */
+        int order_; /* the 3-bit DCT order of the shorter side */
+        float l_dc_; /* the DC terms */
+        float p_dc_;
+        float q_dc_;
+        float a_dc_; /* 1 without alpha */
+        float l_scale_; /* the scales of the AC terms, before any saturation boost */
+        float p_scale_;
+        float q_scale_;
+        float a_scale_; /* 0 without alpha */
+        bool has_alpha_;
+        bool is_landscape_;
+        int lx_; /* the DCT order of the luminance channel, at least 3 */
+        int ly_;
+        int ac_start_; /* the index of the first packed AC byte */
+        int ac_count_; /* the number of AC nibbles across every channel */
+
+        /**
+         * Constructs the header of an opaque grey hash with no AC terms, to be Parsed before use.
+        */
+        ThumbHashHeader();
+
+        /**
+         * Parses the 5 or 6 header bytes of a hash. This is the only place the header layout
+         * is read; every decoder goes through it.
+         *
          * @param hash - the unsigned 8-bit integer array
-         * @param start - the start index for the decoder
-         * @param index - the current index in the decoder
-         * @returns the current index in the decoder
+         * @param size - the number of bytes in hash
+         * @return true, if the hash is long enough to hold its header.
+        */
+        bool Parse(const uint8_t* hash, size_t size);
+
+        /**
+         * @returns the number of bytes a hash with this header must have, ac_start_ + (ac_count_ + 1) / 2
+        */
+        size_t HashSize() const;
+};
+
+class ThumbHashScratch {
+    public:
+        vector<float> l_; /* the luminance plane */
+        vector<float> p_; /* the yellow - blue plane */
+        vector<float> q_; /* the red - green plane */
+        vector<float> a_; /* the alpha plane */
+        Channel l_channel_; /* the DCT terms of each plane */
+        Channel p_channel_;
+        Channel q_channel_;
+        Channel a_channel_;
+        vector<float> fx_; /* the float encoder's row of cosines */
+        vector<int32_t> fixed_fx_; /* the fixed-point encoder's Q15 cosine tables */
+        vector<int32_t> fixed_fy_;
+
+        /**
+         * Constructs an empty ThumbHashScratch. The planes grow to the largest image
+         * encoded with it, at most 16 MB for a 1000x1000 image, and keep that capacity,
+         * so once warm an encode through it allocates nothing.
+        */
+        ThumbHashScratch();
+};
+
+/*
+ * Every ThumbHash function is static and reentrant: it reads only its arguments and
+ * tables that are built once, thread-safely, on first use. Any number of threads may
+ * encode and decode at once without locks, as long as they do not share an output
+ * buffer, Image or ThumbHashScratch. Calling through a ThumbHash instance still works.
+ *
+ * The encoders allocate their working planes on every call. A thread that hashes many
+ * images can pass its own ThumbHashScratch instead, for example a thread_local one, so
+ * the planes are allocated once per thread. Decoding into an existing Image allocates
+ * nothing once its pixel buffer is large enough.
+*/
+class ThumbHash {
+    public:
+        static const int kMaxHashSize = 25; /* the longest hash the encoder produces */
+        static const unsigned int kMaxHashEdge = 100; /* the longest side ThumbHash is designed to encode */
+
+        /**
+         * Encodes an Image to a ThumbHash.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @returns the encoded unsigned 8-bit integer array
+        */
+        static vector<uint8_t> RGBAToThumbHash(Image const & image);
+
+        /**
+         * Encodes an Image of any size to a ThumbHash. ThumbHash is meant for images of at most
+         * kMaxHashEdge pixels a side, so larger images are first downscaled to fit; images that
+         * already fit hash exactly like RGBAToThumbHash.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @returns the encoded unsigned 8-bit integer array, empty only if the image is empty
+        */
+        static vector<uint8_t> RGBAToThumbHashDownscaled(Image const & image);
+
+        /**
+         * Encodes an Image to a ThumbHash in a caller-provided buffer, without allocating the hash.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @param hash - receives the hash, at least kMaxHashSize bytes
+         * @returns the number of bytes written, or 0 if the image is too large
+        */
+        static size_t RGBAToThumbHash(Image const & image, uint8_t* hash);
+
+        /**
+         * Encodes an Image to a ThumbHash, optionally averaging in linear light.
+         * Linear-light averaging keeps high-contrast detail from darkening the placeholder.
+         * Samples go through a 256-entry sRGB to linear table, so the pixel loops stay free
+         * of pow(). A linear-light hash has the same layout, and nothing in its bytes records
+         * the mode, so every decode of it must set linear_light as well: ThumbHashToRGBA,
+         * ThumbHashToAverageRGBA, ThumbHashToCSSGradient, BatchDecoder::Decode and the
+         * PlaceholderCache getters all take the flag. Decoded without it, it renders too dark.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @param hash - receives the hash, at least kMaxHashSize bytes
+         * @param linear_light - true to average linear-light values instead of sRGB bytes
+         * @returns the number of bytes written, or 0 if the image is too large
+        */
+        static size_t RGBAToThumbHash(Image const & image, uint8_t* hash, bool linear_light);
+
+        /**
+         * Encodes a PixelImage to a ThumbHash in a caller-provided buffer.
+         * Each sample is converted to LPQA inside the encoder's own passes, so 16-bit and
+         * reduced-channel images are hashed without first being expanded to RGBA8. An RGBA8
+         * PixelImage hashes exactly like the equivalent Image.
+         * Grey images, and palettes whose entries are all grey, skip the P and Q planes and
+         * their DCTs, since both are identically zero. Palette images convert each entry once,
+         * so every pixel costs a table lookup.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @param hash - receives the hash, at least kMaxHashSize bytes
+         * @returns the number of bytes written, or 0 if the image is too large
+        */
+        static size_t RGBAToThumbHash(PixelImage const & image, uint8_t* hash);
+
+        /**
+         * Encodes an Image to a ThumbHash, reusing the working planes in scratch.
+         * Produces exactly the same hash as the overload without scratch.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @param hash - receives the hash, at least kMaxHashSize bytes
+         * @param linear_light - true to average linear-light values instead of sRGB bytes
+         * @param scratch - working planes owned by the calling thread
+         * @returns the number of bytes written, or 0 if the image is too large
+        */
+        static size_t RGBAToThumbHash(Image const & image, uint8_t* hash, bool linear_light,
+                ThumbHashScratch& scratch);
+
+        /**
+         * Encodes a PixelImage to a ThumbHash, reusing the working planes in scratch.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @param hash - receives the hash, at least kMaxHashSize bytes
+         * @param scratch - working planes owned by the calling thread
+         * @returns the number of bytes written, or 0 if the image is too large
+        */
+        static size_t RGBAToThumbHash(PixelImage const & image, uint8_t* hash, ThumbHashScratch& scratch);
+
+        /**
+         * Encodes an Image to a ThumbHash with integer arithmetic only.
+         * The colour conversion, the cosine tables and the DCT sums are exact fixed-point,
+         * and every rounding is explicit, so the hash is bit-identical on every compiler,
+         * platform and SIMD width. It matches RGBAToThumbHash except where the float encoder
+         * lands within rounding error of a quantization step.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @param hash - receives the hash, at least kMaxHashSize bytes
+         * @returns the number of bytes written, or 0 if the image is empty or too large
+        */
+        static size_t RGBAToThumbHashFixedPoint(Image const & image, uint8_t* hash);
+
+        /**
+         * Encodes an Image to a ThumbHash with integer arithmetic only, reusing the cosine
+         * tables in scratch. Produces exactly the same hash as the overload without scratch.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @param hash - receives the hash, at least kMaxHashSize bytes
+         * @param scratch - working tables owned by the calling thread
+         * @returns the number of bytes written, or 0 if the image is empty or too large
+        */
+        static size_t RGBAToThumbHashFixedPoint(Image const & image, uint8_t* hash, ThumbHashScratch& scratch);
+
+        /**
+         * Encodes an Image to a ThumbHash with integer arithmetic only.
+         * 
+         * @param image - the image to be converted to a ThumbHash
+         * @returns the encoded unsigned 8-bit integer array, empty if the image is too large
+        */
+        static vector<uint8_t> RGBAToThumbHashFixedPoint(Image const & image);
+
+        /**
+         * Decodes a ThumbHash to an Image.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @returns the decoded image
+        */
+        static Image ThumbHashToRGBA(vector<uint8_t> const & hash);
+
+        /**
+         * Decodes a ThumbHash to an Image of the given size.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image
+         * @param height - the height of the decoded image
+         * @returns the decoded image
+        */
+        static Image ThumbHashToRGBA(vector<uint8_t> const & hash, unsigned int width, unsigned int height);
+
+        /**
+         * Decodes a ThumbHash to an Image of the given size, optionally from linear light.
+         * Linear-light colours are re-encoded to sRGB by a binary search over the 255 midpoints
+         * between consecutive sRGB bytes, which rounds exactly in sRGB without calling pow().
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image
+         * @param height - the height of the decoded image
+         * @param linear_light - true if the hash was encoded with linear_light set
+         * @returns the decoded image
+        */
+        static Image ThumbHashToRGBA(vector<uint8_t> const & hash, unsigned int width, unsigned int height,
+                bool linear_light);
+
+        /**
+         * Decodes a ThumbHash into an existing Image, reusing its pixel buffer when it is
+         * large enough, so a thread that keeps one Image decodes without allocating at all.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param width - the width of the decoded image
+         * @param height - the height of the decoded image
+         * @param linear_light - true if the hash was encoded with linear_light set
+         * @param image - receives the decoded image
+        */
+        static void ThumbHashToRGBA(vector<uint8_t> const & hash, unsigned int width, unsigned int height,
+                bool linear_light, Image& image);
+
+        /**
+         * Computes the average colour from a given thumbhash.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @returns the average rgba values
+        */
+        static RGBAPixel ThumbHashToAverageRGBA(vector<uint8_t> const & hash);
+
+        /**
+         * Computes the average colour from a given thumbhash, optionally from linear light.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param linear_light - true if the hash was encoded with linear_light set
+         * @returns the average rgba values
+        */
+        static RGBAPixel ThumbHashToAverageRGBA(vector<uint8_t> const & hash, bool linear_light);
+
+        /**
+         * Computes the approximate aspect ratio (width / height) from a given thumbhash.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @returns the approximate aspect ratio
+        */
+        static double ThumbHashToApproximateAspectRatio(vector<uint8_t> const & hash);
+
+        /**
+         * Converts a ThumbHash directly to CSS background declarations, without rendering an image.
+         * The average colour becomes the background colour, and the low-frequency L, P, Q and A
+         * terms are sampled into a stack of horizontal linear gradients, one per band.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param rows - the number of horizontal gradient bands, at least 1
+         * @param columns - the number of colour stops in each band, at least 2
+         * @returns the CSS declarations, or an empty string if the hash is too short
+        */
+        static string ThumbHashToCSSGradient(vector<uint8_t> const & hash, int rows, int columns);
+
+        /**
+         * Converts a ThumbHash directly to CSS background declarations, optionally from linear light.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @param rows - the number of horizontal gradient bands, at least 1
+         * @param columns - the number of colour stops in each band, at least 2
+         * @param linear_light - true if the hash was encoded with linear_light set
+         * @returns the CSS declarations, or an empty string if the hash is too short
+        */
+        static string ThumbHashToCSSGradient(vector<uint8_t> const & hash, int rows, int columns,
+                bool linear_light);
+
+        /**
+         * Re-encodes a decoded linear-light colour component as an sRGB byte, the way the
+         * linear_light decoders do.
+         * 
+         * @param value - the linear-light value, clamped to [0, 1]
+         * @returns the sRGB byte
+        */
+        static unsigned char LinearToSRGB(float value);
+
+        /**
+         * Checks that a hash is long enough for the channel sizes its header declares.
+         * The decoders do not bounds-check, so untrusted hashes should be validated first.
+         * 
+         * @param hash - the unsigned 8-bit integer array
+         * @returns true, if the hash can be safely decoded
+        */
+        static bool IsValidThumbHash(vector<uint8_t> const & hash);
+
+        /**
+         * Checks that a hash is long enough for the channel sizes its header declares,
+         * without allocating.
+         * 
+         * @param hash - the hash bytes
+         * @param size - the number of bytes in hash
+         * @returns true, if the hash can be safely decoded
         */
-        int Write(vector<uint8_t>& hash, int start, int index);
+        static bool IsValidThumbHash(const uint8_t* hash, size_t size);
 };
 
 #endif
\ No newline at end of file